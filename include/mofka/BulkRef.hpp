@@ -23,6 +23,7 @@ struct BulkRef {
     size_t         offset;  /*!< Offset at which the data starts in the bulk handle */
     size_t         size;    /*!< Size of the data */
     std::string    address; /*!< Address of the process where the data is located (empty string for current process) */
+    bool           shares_previous_handle = false; /*!< Whether handle is the same as that of the BulkRef passed before this one to the same RPC */
 
     template<typename A>
     void serialize(A& ar) {
@@ -30,6 +31,7 @@ struct BulkRef {
         ar(offset);
         ar(size);
         ar(address);
+        ar(shares_previous_handle);
     }
 };
 
@@ -0,0 +1,83 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_COMPRESSION_H
+#define MOFKA_COMPRESSION_H
+
+#include <diaspora/Metadata.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace mofka {
+
+/**
+ * @brief Codecs that can be used to compress the metadata of a topic's
+ * events. Producers compress the metadata of each batch as one block,
+ * which partitions decompress before storing it; data is not compressed.
+ * LZ4 and Zstd are only available if Mofka was built with ENABLE_LZ4
+ * and ENABLE_ZSTD respectively.
+ */
+enum class CompressionCodec : uint8_t {
+    None = 0,
+    LZ4  = 1,
+    Zstd = 2
+};
+
+/**
+ * @brief Compression settings of a topic, stored with the topic in the
+ * master database as {"codec": "none"|"lz4"|"zstd", "level": <int>}.
+ */
+struct CompressionConfig {
+
+    CompressionCodec codec = CompressionCodec::None;
+    int              level = 0;
+
+    bool enabled() const {
+        return codec != CompressionCodec::None;
+    }
+
+    /**
+     * @brief Parses the settings from a Metadata object. A null or empty
+     * object means no compression. Throws a diaspora::Exception if the
+     * codec is unknown.
+     */
+    static CompressionConfig FromMetadata(const diaspora::Metadata& md);
+
+    /**
+     * @brief Converts the settings into a Metadata object.
+     */
+    diaspora::Metadata toMetadata() const;
+
+    /**
+     * @brief Whether this build of Mofka supports the given codec.
+     */
+    static bool IsAvailable(CompressionCodec codec);
+};
+
+/**
+ * @brief Compresses size bytes from data and appends the result to
+ * output, preceded by the uncompressed size (as a size_t).
+ * Throws a diaspora::Exception if the codec is not available.
+ */
+void CompressAppend(const CompressionConfig& config,
+                    const char* data, size_t size,
+                    std::vector<char>& output);
+
+/**
+ * @brief Decompresses a block produced by CompressAppend into output
+ * (which is resized to the uncompressed size).
+ * Throws a diaspora::Exception if the block is invalid, including if its
+ * uncompressed size is more than the codec could produce from it, or if
+ * the codec is not available.
+ */
+void Decompress(CompressionCodec codec,
+                const char* data, size_t size,
+                std::vector<char>& output);
+
+}
+
+#endif
@@ -12,18 +12,27 @@
 #include <mofka/UUID.hpp>
 #include <mofka/BulkRef.hpp>
 #include <mofka/Promise.hpp>
+#include <mofka/MofkaEventBatch.hpp>
 
 #include <diaspora/Consumer.hpp>
 
 #include <thallium.hpp>
+#include <thallium/bulk_buffer_pool.hpp>
 #include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <deque>
 #include <queue>
+#include <unordered_map>
+#include <vector>
 
 namespace mofka {
 
 namespace tl = thallium;
 
 class MofkaTopicHandle;
+class ConsumerBatchImpl;
+template<typename T> class Result;
 
 class MofkaConsumer : public diaspora::ConsumerInterface {
 
@@ -45,13 +54,29 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
     std::shared_ptr<MofkaTopicHandle>                m_topic;
     std::vector<std::shared_ptr<MofkaPartitionInfo>> m_partitions;
 
+    size_t              m_data_request_max_events = 64;
+    size_t              m_data_prefetch_window = 4;
+    size_t              m_process_max_concurrency = 16;
+    bool                m_process_ordered = false;
+    bool                m_pull_batches = false;
+
     std::string         m_self_addr;
+
+    /* pre-registered buffers the batches are pulled into; shared with the
+     * batches, which may outlive the consumer through their events */
+    std::shared_ptr<thallium::bulk_buffer_pool<>> m_recv_buffer_pool;
+
+    /* endpoints of the processes feeding this consumer */
+    std::unordered_map<std::string, thallium::endpoint> m_endpoints;
+    thallium::mutex                                     m_endpoints_mtx;
     std::atomic<size_t> m_completed_partitions = 0;
 
     tl::remote_procedure m_consumer_request_events;
     tl::remote_procedure m_consumer_ack_event;
     tl::remote_procedure m_consumer_remove_consumer;
+    tl::remote_procedure m_consumer_grant_credits;
     tl::remote_procedure m_consumer_request_data;
+    tl::remote_procedure m_consumer_request_data_batch;
     tl::remote_procedure m_consumer_recv_batch;
 
     std::shared_ptr<MofkaConsumer> shared_from_this_mofka() {
@@ -74,13 +99,25 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
      * of the queue. If the user calls pull(), it will use the future
      * at in m_futures.front() (the oldest created by the consumer)
      * and take it off the queue. This is the symetric of the above.
+     *
+     * Futures created by the consumer also keep the batch their event
+     * comes from, so that the batch's credit can be given back to its
+     * partition once all its events have been pulled.
      */
-    std::deque<
-        std::pair<
-            Promise<std::optional<diaspora::Event>>,
-            diaspora::Future<std::optional<diaspora::Event>>>> m_futures;
-    bool                                                       m_futures_credit = false;
-    thallium::mutex                                            m_futures_mtx;
+    struct QueuedEvent {
+        Promise<std::optional<diaspora::Event>>          promise;
+        diaspora::Future<std::optional<diaspora::Event>> future;
+        std::shared_ptr<ConsumerBatchImpl>               batch;
+    };
+    std::deque<QueuedEvent> m_futures;
+    bool                    m_futures_credit = false;
+    thallium::mutex         m_futures_mtx;
+
+    /* With m_pull_batches, received events that no pull() is waiting for
+     * are queued here as views over their batch, for pullBatch().
+     * Protected by m_futures_mtx. */
+    std::deque<MofkaEventBatch>  m_ready_batches;
+    thallium::condition_variable m_ready_batches_cv;
 
     std::atomic<size_t>      m_pending_ults{0};
     thallium::mutex          m_pending_ults_mtx;
@@ -94,7 +131,13 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
                   diaspora::DataAllocator allocator,
                   diaspora::DataSelector selector,
                   std::shared_ptr<MofkaTopicHandle> topic,
-                  std::vector<std::shared_ptr<MofkaPartitionInfo>> partitions)
+                  std::vector<std::shared_ptr<MofkaPartitionInfo>> partitions,
+                  size_t data_request_max_events = 64,
+                  size_t data_prefetch_window = 4,
+                  size_t process_max_concurrency = 16,
+                  bool process_ordered = false,
+                  bool pull_batches = false,
+                  std::shared_ptr<thallium::bulk_buffer_pool<>> recv_buffer_pool = nullptr)
     : m_engine(std::move(engine))
     , m_name(name)
     , m_batch_size(batch_size)
@@ -104,16 +147,29 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
     , m_data_selector(std::move(selector))
     , m_topic(std::move(topic))
     , m_partitions(std::move(partitions))
+    , m_data_request_max_events(data_request_max_events)
+    , m_data_prefetch_window(std::max<size_t>(data_prefetch_window, 1))
+    , m_process_max_concurrency(std::max<size_t>(process_max_concurrency, 1))
+    , m_process_ordered(process_ordered)
+    , m_pull_batches(pull_batches)
     , m_self_addr(m_engine.self())
+    , m_recv_buffer_pool(recv_buffer_pool ? std::move(recv_buffer_pool) :
+        std::make_shared<thallium::bulk_buffer_pool<>>(
+            m_engine, 1, 0, 64*1024, 4.0f, thallium::bulk_mode::write_only))
     , m_consumer_request_events(m_engine.define("mofka_consumer_request_events"))
     , m_consumer_ack_event(m_engine.define("mofka_consumer_ack_event"))
     , m_consumer_remove_consumer(m_engine.define("mofka_consumer_remove_consumer"))
+    , m_consumer_grant_credits(m_engine.define("mofka_consumer_grant_credits"))
     , m_consumer_request_data(m_engine.define("mofka_consumer_request_data"))
+    , m_consumer_request_data_batch(m_engine.define("mofka_consumer_request_data_batch"))
     , m_consumer_recv_batch(
         m_engine.define("mofka_consumer_recv_batch",
                         forwardBatchToConsumer,
                         0,
                         m_engine.get_progress_pool()))
+    , m_received_batches(m_partitions.size())
+    , m_delivered_batches(m_partitions.size(), 0)
+    , m_credits_to_return(m_partitions.size())
     {}
 
     ~MofkaConsumer() {
@@ -150,20 +206,71 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
 
     void unsubscribe() override;
 
+    /**
+     * @brief Returns a view over at most maxEvents events (0 for no limit)
+     * received in the same batch, waiting up to timeout_ms milliseconds
+     * (forever if negative) for one to be available. The returned view is
+     * empty if the timeout expired, or if noMoreEvents() is true.
+     * Requires the consumer to be created with the "pull_batches" option.
+     */
+    MofkaEventBatch pullBatch(size_t maxEvents, int timeout_ms = -1);
+
+    /**
+     * @brief Runs the processor on events as they arrive, in tasks pushed
+     * to threadPool (or to the consumer's thread pool if null), each task
+     * processing a window of events from the same batch. At most
+     * m_process_max_concurrency tasks run at any time and, if
+     * m_process_ordered is set, the events of a partition are processed
+     * one at a time and in order.
+     *
+     * Returns once maxEvents events have been processed, once all the
+     * partitions have completed, or (if timeout_ms > 0) once no event has
+     * been processed for timeout_ms milliseconds. If the processor throws,
+     * no new task is started and the exception is rethrown once the
+     * running tasks complete. Events received but not processed are left
+     * for pull(). Events whose data could not be fetched are skipped
+     * without stopping the processing; if there were any, an exception
+     * reporting them is thrown once process() is done.
+     */
     void process(diaspora::EventProcessor processor,
                  int timeout_ms,
                  diaspora::NumEvents maxEvents,
-                 std::shared_ptr<diaspora::ThreadPoolInterface> threadPool) override {
-        // TODO
-        (void)timeout_ms;
-        (void)processor;
-        (void)threadPool;
-        (void)maxEvents;
-        throw diaspora::Exception{"MofkaConsumer::process not implemented"};
-    }
+                 std::shared_ptr<diaspora::ThreadPoolInterface> threadPool) override;
 
     private:
 
+    struct ProcessContext;
+
+    /* set while process() runs; batches received while it is set (and no
+     * pull() is waiting) are dispatched to it. Protected by m_futures_mtx. */
+    std::shared_ptr<ProcessContext> m_process_ctx;
+
+    /* number of batches received and fully dispatched for each partition,
+     * used to dispatch batches in order when m_process_ordered is set */
+    std::vector<std::atomic<uint64_t>> m_received_batches;
+    std::vector<uint64_t>              m_delivered_batches;
+    thallium::mutex                    m_delivery_mtx;
+    thallium::condition_variable       m_delivery_cv;
+
+    /* Flow control: each partition may have at most creditWindow() batches
+     * that were sent to this consumer and not entirely handed to the
+     * application. Credits are given back in groups of half the window.
+     * Credits count batches, not bytes (byte-based windows are not
+     * implemented). */
+    std::vector<std::atomic<size_t>>   m_credits_to_return;
+
+    /**
+     * @brief Number of batches a partition may send ahead of the
+     * application (m_max_batch), 0 if unlimited.
+     */
+    size_t creditWindow() const;
+
+    /**
+     * @brief Called when all the events of a batch from the given
+     * partition have been handed to the application.
+     */
+    void returnCredit(size_t partition_index);
+
     void subscribe();
 
     void partitionCompleted();
@@ -178,10 +285,61 @@ class MofkaConsumer : public diaspora::ConsumerInterface {
         const BulkRef &data_desc_sizes,
         const BulkRef &data_desc);
 
-    diaspora::DataView requestData(
+    struct DataRequest;
+
+    /**
+     * @brief Runs the DataSelector and DataAllocator on events [begin, end)
+     * of a batch whose entry in data is still successful, then issues an
+     * asynchronous RPC fetching the data of all of them from the partition.
+     * Per-event failures are reported in the corresponding entry of data.
+     */
+    DataRequest startDataRequest(
         std::shared_ptr<MofkaPartitionInfo> target,
-        diaspora::Metadata metadata,
-        const diaspora::DataDescriptor& descriptor);
+        const std::vector<diaspora::Metadata>& metadata,
+        const std::vector<diaspora::DataDescriptor>& descriptors,
+        std::vector<Result<diaspora::DataView>>& data,
+        size_t begin, size_t end);
+
+    /**
+     * @brief Waits for a DataRequest started by startDataRequest
+     * and reports its per-event results in data.
+     */
+    void completeDataRequest(
+        DataRequest& request,
+        std::vector<Result<diaspora::DataView>>& data);
+
+    /**
+     * @brief Hands events from the same partition to a process() call,
+     * waiting for a free task slot. Events it cannot take (because it
+     * stopped or reached its maximum) are left for pull().
+     */
+    void dispatchToProcessor(
+        const std::shared_ptr<ProcessContext>& ctx,
+        size_t partition_index,
+        const std::shared_ptr<ConsumerBatchImpl>& batch,
+        std::vector<diaspora::Event> events);
+
+    /**
+     * @brief Returns the endpoint for the given address, looking it up
+     * only the first time.
+     */
+    thallium::endpoint lookup(const std::string& address);
+
+    /**
+     * @brief Makes an event of the given batch available to pull().
+     */
+    void pushToPullQueue(diaspora::Event event, std::shared_ptr<ConsumerBatchImpl> batch);
+
+    /**
+     * @brief Hands the events of a batch to the pull() calls waiting for
+     * one and makes the rest available to pullBatch().
+     */
+    void pushReadyBatch(MofkaEventBatch batch);
+
+    /**
+     * @brief Wakes up process() so it can check whether it should return.
+     */
+    void notifyProcess();
 
     static void forwardBatchToConsumer(
             const thallium::request& req,
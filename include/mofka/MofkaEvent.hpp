@@ -9,12 +9,18 @@
 #include <mofka/MofkaPartitionInfo.hpp>
 
 #include <diaspora/Event.hpp>
+#include <diaspora/Serializer.hpp>
+#include <diaspora/BufferWrapperArchive.hpp>
 
 #include <thallium.hpp>
 #include <thallium/serialization/stl/string.hpp>
 #include <thallium/serialization/stl/pair.hpp>
 #include <thallium/serialization/stl/vector.hpp>
 
+#include <mutex>
+#include <optional>
+#include <string_view>
+
 namespace mofka {
 
 class MofkaEvent : public diaspora::EventInterface {
@@ -27,19 +33,36 @@ class MofkaEvent : public diaspora::EventInterface {
     : m_id{diaspora::NoMoreEvents}
     {}
 
+    /**
+     * @brief Creates an event whose metadata is the raw_metadata_size bytes
+     * at raw_metadata, as received from the partition. raw_metadata usually
+     * aliases the buffer of the batch the event was received in, keeping it alive.
+     * The metadata is only deserialized on the first call to metadata(),
+     * unless it is already provided.
+     */
     MofkaEvent(diaspora::EventID id,
                std::shared_ptr<MofkaPartitionInfo> partition,
-               diaspora::Metadata metadata,
+               std::shared_ptr<const char> raw_metadata,
+               size_t raw_metadata_size,
+               diaspora::Serializer serializer,
                diaspora::DataView data,
                std::string consumer_name,
-               thallium::remote_procedure ack_rpc)
+               thallium::remote_procedure ack_rpc,
+               std::optional<diaspora::Metadata> metadata = std::nullopt)
     : m_id(std::move(id))
     , m_partition(std::move(partition))
-    , m_metadata{std::move(metadata)}
+    , m_raw_metadata{std::move(raw_metadata)}
+    , m_raw_metadata_size{raw_metadata_size}
+    , m_serializer{std::move(serializer)}
     , m_data{std::move(data)}
     , m_consumer_name{std::move(consumer_name)}
     , m_acknowledge_rpc{std::move(ack_rpc)}
-    {}
+    {
+        if(metadata) {
+            m_metadata = std::move(*metadata);
+            std::call_once(m_metadata_once, [](){});
+        }
+    }
 
     void acknowledge() const override {
         using namespace std::string_literals;
@@ -61,9 +84,23 @@ class MofkaEvent : public diaspora::EventInterface {
     }
 
     const diaspora::Metadata& metadata() const override {
+        std::call_once(m_metadata_once, [this]() {
+            if(!m_raw_metadata) return;
+            diaspora::BufferWrapperInputArchive archive{rawMetadata()};
+            m_serializer->deserialize(archive, m_metadata);
+        });
         return m_metadata;
     }
 
+    /**
+     * @brief Serialized metadata of the event, for applications that
+     * forward it without looking at it.
+     */
+    std::string_view rawMetadata() const {
+        if(!m_raw_metadata) return {};
+        return std::string_view{m_raw_metadata.get(), m_raw_metadata_size};
+    }
+
     const diaspora::DataView& data() const override {
         return m_data;
     }
@@ -76,7 +113,11 @@ class MofkaEvent : public diaspora::EventInterface {
 
     diaspora::EventID                   m_id;
     std::shared_ptr<MofkaPartitionInfo> m_partition;
-    diaspora::Metadata                  m_metadata;
+    std::shared_ptr<const char>         m_raw_metadata;
+    size_t                              m_raw_metadata_size = 0;
+    std::optional<diaspora::Serializer> m_serializer;
+    mutable std::once_flag              m_metadata_once;
+    mutable diaspora::Metadata          m_metadata;
     diaspora::DataView                  m_data;
 
     std::string                m_consumer_name;
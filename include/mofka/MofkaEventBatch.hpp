@@ -0,0 +1,119 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_EVENT_BATCH_H
+#define MOFKA_EVENT_BATCH_H
+
+#include <diaspora/Event.hpp>
+#include <diaspora/EventID.hpp>
+#include <diaspora/Metadata.hpp>
+#include <diaspora/DataView.hpp>
+
+#include <memory>
+
+namespace mofka {
+
+class ConsumerBatchImpl;
+class MofkaConsumer;
+
+/**
+ * @brief View over a contiguous range of events received by a consumer
+ * in the same batch from the same partition, returned by
+ * MofkaConsumer::pullBatch(). Event i of the view has ID firstID()+i.
+ *
+ * The view shares ownership of the received batch, so it stays valid
+ * after the consumer moves on. Metadata is deserialized on first access
+ * to metadata(i) (unless the consumer's DataSelector or DataAllocator
+ * already needed it), and no per-event object is created unless event(i)
+ * is called.
+ */
+class MofkaEventBatch {
+
+    friend class MofkaConsumer;
+
+    public:
+
+    MofkaEventBatch() = default;
+    MofkaEventBatch(const MofkaEventBatch&) = default;
+    MofkaEventBatch(MofkaEventBatch&&) = default;
+    MofkaEventBatch& operator=(const MofkaEventBatch&) = default;
+    MofkaEventBatch& operator=(MofkaEventBatch&&) = default;
+    ~MofkaEventBatch() = default;
+
+    /**
+     * @brief Number of events in the view.
+     */
+    size_t size() const {
+        return m_end - m_begin;
+    }
+
+    bool empty() const {
+        return m_end == m_begin;
+    }
+
+    /**
+     * @brief Returns true if the view is empty because all the partitions
+     * of the consumer have completed and all their events were pulled.
+     */
+    bool noMoreEvents() const {
+        return m_no_more_events;
+    }
+
+    /**
+     * @brief ID of the first event in the view.
+     */
+    diaspora::EventID firstID() const;
+
+    /**
+     * @brief ID of event i of the view.
+     */
+    diaspora::EventID id(size_t i) const {
+        return firstID() + i;
+    }
+
+    /**
+     * @brief Metadata of event i, deserialized on first access.
+     * Throws a diaspora::Exception if it cannot be deserialized.
+     */
+    const diaspora::Metadata& metadata(size_t i) const;
+
+    /**
+     * @brief Data of event i. Throws a diaspora::Exception if the
+     * data of this event could not be retrieved.
+     */
+    const diaspora::DataView& data(size_t i) const;
+
+    /**
+     * @brief Partition the events come from.
+     */
+    diaspora::PartitionInfo partition() const;
+
+    /**
+     * @brief Creates a standalone diaspora::Event for event i.
+     */
+    diaspora::Event event(size_t i) const;
+
+    /**
+     * @brief Acknowledges the last event of the view (and therefore
+     * all the events before it in the partition).
+     */
+    void acknowledge() const;
+
+    private:
+
+    MofkaEventBatch(std::shared_ptr<ConsumerBatchImpl> batch, size_t begin, size_t end)
+    : m_batch{std::move(batch)}
+    , m_begin{begin}
+    , m_end{end} {}
+
+    std::shared_ptr<ConsumerBatchImpl> m_batch;
+    size_t                             m_begin = 0;
+    size_t                             m_end   = 0;
+    bool                               m_no_more_events = false;
+};
+
+}
+
+#endif
@@ -16,6 +16,9 @@
 #include <diaspora/Ordering.hpp>
 
 #include <thallium.hpp>
+#include <atomic>
+#include <chrono>
+#include <optional>
 #include <string_view>
 #include <queue>
 
@@ -39,12 +42,29 @@ class MofkaProducer : public diaspora::ProducerInterface {
     std::shared_ptr<MofkaTopicHandle> m_topic;
     tl::remote_procedure              m_producer_send_batch;
     bool                              m_ack_early = false;
+    bool                              m_serialize_on_push = false;
+    size_t                            m_batch_max_bytes = 0;
+    std::chrono::microseconds         m_batch_linger{0};
+    size_t                            m_small_event_threshold = 0;
 
+    /* m_batch_queues owns the queues and is protected by m_batch_queues_mtx,
+     * m_batch_queue_ptrs publishes them so push() can find them lock-free */
     std::vector<std::shared_ptr<ActiveProducerBatchQueue>> m_batch_queues;
+    std::vector<std::atomic<ActiveProducerBatchQueue*>>    m_batch_queue_ptrs;
     thallium::mutex                                        m_batch_queues_mtx;
     thallium::condition_variable                           m_batch_queues_cv;
     std::atomic<size_t>                                    m_num_pushed_events = 0;
 
+    /**
+     * @brief Statistics of the producer, summed over its partitions.
+     */
+    struct Stats {
+        size_t pushed_events     = 0; /* events successfully pushed so far */
+        size_t queued_events     = 0; /* events pushed but not yet sent */
+        size_t queued_bytes      = 0; /* data (and serialized metadata) bytes of these events */
+        size_t in_flight_batches = 0; /* batches sent and waiting for a response */
+    };
+
     MofkaProducer(tl::engine engine,
                   std::string_view name,
                   diaspora::BatchSize batch_size,
@@ -52,7 +72,11 @@ class MofkaProducer : public diaspora::ProducerInterface {
                   diaspora::Ordering ordering,
                   std::shared_ptr<MofkaThreadPool> thread_pool,
                   std::shared_ptr<MofkaTopicHandle> topic,
-                  bool ack_early = false);
+                  bool ack_early = false,
+                  bool serialize_on_push = false,
+                  size_t batch_max_bytes = 0,
+                  std::chrono::microseconds batch_linger = std::chrono::microseconds{0},
+                  size_t small_event_threshold = 0);
 
     ~MofkaProducer();
 
@@ -83,8 +107,42 @@ class MofkaProducer : public diaspora::ProducerInterface {
             diaspora::DataView data,
             std::optional<size_t> partition) override;
 
+    /**
+     * @brief Same as push, but instead of blocking while the queue of
+     * the selected partition is full, waits at most timeout (not at all
+     * by default). Returns std::nullopt if the event could not be pushed
+     * in time, in which case metadata and data are left untouched so the
+     * caller can retry, spill, or drop them. Otherwise they are moved
+     * from and the event's future is returned.
+     *
+     * If no partition is requested, the partition is selected first, so
+     * a rejected event still counts in the selector's state (e.g. the
+     * next event goes to the next partition in a round-robin).
+     */
+    std::optional<diaspora::Future<std::optional<diaspora::EventID>>> tryPush(
+            diaspora::Metadata& metadata,
+            diaspora::DataView& data,
+            std::optional<size_t> partition = std::nullopt,
+            std::chrono::microseconds timeout = std::chrono::microseconds{0});
+
     diaspora::Future<std::optional<diaspora::Flushed>> flush() override;
 
+    /**
+     * @brief Returns the current statistics of the producer. This call
+     * does not take any lock; the values are only a snapshot.
+     */
+    Stats stats() const;
+
+    private:
+
+    ActiveProducerBatchQueue* getQueue(size_t partition_index);
+
+    std::optional<diaspora::Future<std::optional<diaspora::EventID>>> pushWithDeadline(
+            diaspora::Metadata& metadata,
+            diaspora::DataView& data,
+            std::optional<size_t> partition,
+            std::optional<std::chrono::steady_clock::time_point> deadline);
+
 };
 
 }
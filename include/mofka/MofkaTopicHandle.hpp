@@ -15,6 +15,7 @@
 
 #include <mofka/MofkaPartitionInfo.hpp>
 #include <mofka/MofkaProducer.hpp>
+#include <mofka/Compression.hpp>
 
 #include <string_view>
 
@@ -37,6 +38,7 @@ class MofkaTopicHandle : public diaspora::TopicHandleInterface,
     std::vector<std::shared_ptr<MofkaPartitionInfo>> m_partitions;
     std::vector<diaspora::PartitionInfo>             m_partitions_info;
     std::shared_ptr<MofkaDriver>                     m_driver;
+    CompressionConfig                                m_compression;
 
     MofkaTopicHandle() = default;
 
@@ -46,14 +48,16 @@ class MofkaTopicHandle : public diaspora::TopicHandleInterface,
                      diaspora::PartitionSelector selector,
                      diaspora::Serializer serializer,
                      std::vector<std::shared_ptr<MofkaPartitionInfo>> partitions,
-                     std::shared_ptr<MofkaDriver> driver)
+                     std::shared_ptr<MofkaDriver> driver,
+                     CompressionConfig compression = {})
     : m_engine{std::move(engine)}
     , m_name(name)
     , m_validator(std::move(validator))
     , m_selector(std::move(selector))
     , m_serializer(std::move(serializer))
     , m_partitions(std::move(partitions))
-    , m_driver(std::move(driver)) {
+    , m_driver(std::move(driver))
+    , m_compression(compression) {
         m_partitions_info.reserve(m_partitions.size());
         for(auto& p : m_partitions) {
             m_partitions_info.push_back(p->toPartitionInfo());
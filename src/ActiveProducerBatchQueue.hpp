@@ -7,6 +7,7 @@
 #define MOFKA_ACTIVE_PRODUCER_BATCH_QUEUE_H
 
 #include "ProducerBatch.hpp"
+#include "MPSCRingBuffer.hpp"
 
 #include <mofka/Promise.hpp>
 
@@ -14,33 +15,64 @@
 #include <diaspora/Future.hpp>
 
 #include <thallium.hpp>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <optional>
+#include <limits>
 #include <vector>
+#include <chrono>
 #include <cstdint>
 
 namespace mofka {
 
 namespace tl = thallium;
 
+/**
+ * @brief Queue of events to send to a partition.
+ *
+ * Application threads push events into a lock-free ring buffer. A single
+ * sender ULT drains the ring in bulk into ProducerBatch objects, which it
+ * sends. Pushing only takes m_mutex when the ring is full or when the
+ * sender is sleeping and the new event is one it wants to be woken for.
+ */
 class ActiveProducerBatchQueue {
 
     public:
 
     using NewBatchFn = std::function<std::shared_ptr<ProducerBatch>()>;
 
+    /* A batch is sent as soon as it has batch_size events (if the batch
+     * size is not adaptive), max_bytes bytes (if not 0), or linger time
+     * has passed since its first event was pushed (if not 0). With an
+     * adaptive batch size and no linger time, batches are sent as soon
+     * as the sender is available.
+     */
+    struct BatchingPolicy {
+        size_t                    max_bytes = 0;
+        std::chrono::microseconds linger{0};
+    };
+
     ActiveProducerBatchQueue(
         NewBatchFn new_batch,
         std::shared_ptr<diaspora::ThreadPoolInterface> thread_pool,
         diaspora::BatchSize batch_size,
-        diaspora::MaxNumBatches max_batch)
+        diaspora::MaxNumBatches max_batch,
+        size_t max_in_flight = 1,
+        BatchingPolicy policy = BatchingPolicy{})
     : m_create_new_batch{std::move(new_batch)}
     , m_thread_pool{std::move(thread_pool)}
     , m_batch_size{batch_size}
     , m_max_batch{max_batch}
+    , m_max_in_flight{max_in_flight}
+    , m_policy{policy}
+    , m_ring{RingCapacity(batch_size, max_batch)}
     {
         if(m_max_batch.value == 0)
             m_max_batch.value = 1;
+        if(m_max_in_flight == 0)
+            m_max_in_flight = 1;
         start();
     }
 
@@ -48,41 +80,55 @@ class ActiveProducerBatchQueue {
         stop();
     }
 
-    void push(diaspora::Metadata metadata,
-              diaspora::DataView data,
-              Promise<std::optional<diaspora::EventID>> promise) {
-        bool need_notification;
-        {
-            auto adaptive = m_batch_size == diaspora::BatchSize::Adaptive();
-            need_notification = adaptive;
-            std::unique_lock<thallium::mutex> guard{m_mutex};
-            if(m_batch_queue.empty()) {
-                //if(m_reusable_batches.empty()) {
-                    m_batch_queue.push(m_create_new_batch());
-                //} else {
-                //    m_batch_queue.push(m_reusable_batches.front());
-                //    m_reusable_batches.pop_front();
-                //}
-            }
-            auto last_batch = m_batch_queue.back();
-            if(!adaptive && last_batch->count() == m_batch_size.value) {
-                //if(m_reusable_batches.empty()) {
-                m_cv.wait(guard, [this]() {
-                    return m_batch_queue.size() < m_max_batch.value;
-                });
-                m_batch_queue.push(m_create_new_batch());
-                //} else {
-                //    m_batch_queue.push(m_reusable_batches.front());
-                //    m_reusable_batches.pop_front();
-                //}
-                last_batch = m_batch_queue.back();
-                need_notification = true;
-            }
-            last_batch->push(std::move(metadata), std::move(data), std::move(promise));
-        }
-        if(need_notification) {
-            m_cv.notify_one();
-        }
+    using Deadline = std::optional<std::chrono::steady_clock::time_point>;
+
+    /* Pushes an event, blocking while the queue is full. If a deadline
+     * is given and the queue is still full when it passes, returns false
+     * and leaves metadata and data untouched; otherwise they are moved
+     * from and the function returns true.
+     */
+    bool push(diaspora::Metadata& metadata,
+              diaspora::DataView& data,
+              Promise<std::optional<diaspora::EventID>> promise,
+              Deadline deadline = std::nullopt) {
+        PendingEvent event;
+        event.metadata = std::move(metadata);
+        event.data     = std::move(data);
+        event.promise  = std::move(promise);
+        if(enqueue(event, deadline)) return true;
+        metadata = std::move(event.metadata);
+        data     = std::move(event.data);
+        return false;
+    }
+
+    /* Used if the producer serializes the metadata on push. */
+    bool push(std::vector<char> serialized_metadata,
+              diaspora::DataView& data,
+              Promise<std::optional<diaspora::EventID>> promise,
+              Deadline deadline = std::nullopt) {
+        PendingEvent event;
+        event.serialized_metadata = std::move(serialized_metadata);
+        event.serialized          = true;
+        event.data                = std::move(data);
+        event.promise             = std::move(promise);
+        if(enqueue(event, deadline)) return true;
+        data = std::move(event.data);
+        return false;
+    }
+
+    /* Events pushed but not yet sent, and their size in bytes
+     * (same accounting as ProducerBatch::byteSize()) */
+    size_t queuedEvents() const {
+        return m_queued_events.load(std::memory_order_relaxed);
+    }
+
+    size_t queuedBytes() const {
+        return m_queued_bytes.load(std::memory_order_relaxed);
+    }
+
+    /* Batches sent and waiting for their response */
+    size_t inFlightBatches() const {
+        return m_in_flight_batches.load(std::memory_order_relaxed);
     }
 
     void stop() {
@@ -91,7 +137,7 @@ class ActiveProducerBatchQueue {
             std::unique_lock<thallium::mutex> guard{m_mutex};
             m_need_stop = true;
         }
-        m_cv.notify_one();
+        m_sender_cv.notify_one();
         m_terminated.wait();
         m_terminated.reset();
     }
@@ -110,25 +156,25 @@ class ActiveProducerBatchQueue {
         {
             std::unique_lock<thallium::mutex> guard{m_mutex};
             m_request_flush = true;
-            m_cv.notify_one();
+            m_sender_cv.notify_one();
         }
         return diaspora::Future<std::optional<diaspora::Flushed>>{
             [this](int timeout_ms) -> std::optional<diaspora::Flushed> {
                 if(timeout_ms <= 0) {
                     std::unique_lock<thallium::mutex> guard{m_mutex};
-                    m_cv.wait(guard, [this]() {
-                        return m_batch_queue.empty() && m_request_flush == false;
+                    m_flushed_cv.wait(guard, [this]() {
+                        return m_request_flush == false;
                     });
                     return diaspora::Flushed{};
                 } else {
                     auto now = std::chrono::steady_clock::now();
                     auto deadline = now + std::chrono::milliseconds{timeout_ms};
                     std::unique_lock<thallium::mutex> guard{m_mutex};
-                    while(!(m_batch_queue.empty() && m_request_flush == false) && (now < deadline)) {
-                        m_cv.wait_until(guard, deadline);
+                    while(m_request_flush && (now < deadline)) {
+                        m_flushed_cv.wait_until(guard, deadline);
                         now = std::chrono::steady_clock::now();
                     }
-                    if(m_batch_queue.empty() && m_request_flush == false)
+                    if(m_request_flush == false)
                         return diaspora::Flushed{};
                     else
                         return std::nullopt;
@@ -136,37 +182,198 @@ class ActiveProducerBatchQueue {
             },
             [this]() {
                 std::unique_lock<thallium::mutex> guard{m_mutex};
-                return m_batch_queue.empty() && m_request_flush == false;
+                return m_request_flush == false;
             }};
     }
 
     private:
 
-    void loop() {
-        std::unique_lock<thallium::mutex> guard{m_mutex};
-        while(!m_need_stop || !m_batch_queue.empty()) {
-            m_cv.wait(guard, [this]() {
-                if(m_need_stop || m_request_flush)        return true;
-                if(m_batch_queue.empty())                 return false;
-                if(m_batch_size == diaspora::BatchSize::Adaptive()) return true;
-                auto& batch = m_batch_queue.front();
-                if(batch->count() == m_batch_size.value)  return true;
+    struct PendingEvent {
+        diaspora::Metadata                        metadata;
+        std::vector<char>                         serialized_metadata;
+        bool                                      serialized = false;
+        diaspora::DataView                        data;
+        Promise<std::optional<diaspora::EventID>> promise;
+
+        /* same accounting as ProducerBatch::byteSize() */
+        size_t byteSize() const {
+            return data.size() + (serialized ? serialized_metadata.size() : 0);
+        }
+    };
+
+    static size_t RingCapacity(diaspora::BatchSize batch_size,
+                               diaspora::MaxNumBatches max_batch) {
+        if(batch_size == diaspora::BatchSize::Adaptive())
+            return 8192;
+        return std::clamp<size_t>(batch_size.value*std::max<size_t>(max_batch.value, 1), 256, 8192);
+    }
+
+    bool enqueue(PendingEvent& event, Deadline deadline) {
+        const size_t bytes = event.byteSize();
+        // counted before the event becomes visible to the sender,
+        // which subtracts it when sending its batch
+        m_queued_events.fetch_add(1, std::memory_order_relaxed);
+        m_queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        size_t position;
+        while(!m_ring.tryPush(event, &position)) {
+            // the ring is full, wait for the sender to drain it
+            if(deadline && std::chrono::steady_clock::now() >= *deadline) {
+                m_queued_events.fetch_sub(1, std::memory_order_relaxed);
+                m_queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
                 return false;
-            });
-            if(m_batch_queue.empty()) {
+            }
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            m_waiting_pushers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool pushed = m_ring.tryPush(event, &position);
+            if(!pushed) {
+                m_sender_cv.notify_one();
+                if(deadline) m_space_cv.wait_until(guard, *deadline);
+                else         m_space_cv.wait(guard);
+            }
+            m_waiting_pushers.fetch_sub(1);
+            if(pushed) break;
+        }
+        size_t total_bytes = m_policy.max_bytes != 0
+                           ? m_pushed_bytes.fetch_add(bytes) + bytes : 0;
+        // wake up the sender only if it sleeps and waits for this event
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_sender_sleeping.load(std::memory_order_relaxed)
+        && (position + 1 >= m_wake_at.load(std::memory_order_relaxed)
+         || total_bytes >= m_wake_at_bytes.load(std::memory_order_relaxed))) {
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            m_sender_cv.notify_one();
+        }
+        return true;
+    }
+
+    /* Only called by the sender. Completed batches are reused,
+     * so their buffers and metadata registration are kept.
+     */
+    std::shared_ptr<ProducerBatch> getNewBatch() {
+        if(m_reusable_batches.empty())
+            return m_create_new_batch();
+        auto batch = std::move(m_reusable_batches.back());
+        m_reusable_batches.pop_back();
+        return batch;
+    }
+
+    bool isFull(const ProducerBatch& batch) const {
+        if(m_batch_size != diaspora::BatchSize::Adaptive()
+        && batch.count() >= m_batch_size.value)            return true;
+        if(m_policy.max_bytes != 0
+        && batch.byteSize() >= m_policy.max_bytes)         return true;
+        return false;
+    }
+
+    bool isReadyToSend(const ProducerBatch& batch) const {
+        if(m_need_stop || m_request_flush)                  return true;
+        if(isFull(batch))                                   return true;
+        if(m_policy.linger.count() != 0)
+            return std::chrono::steady_clock::now() - batch.firstPushTime() >= m_policy.linger;
+        return m_batch_size == diaspora::BatchSize::Adaptive();
+    }
+
+    /* Batches are started in order and up to m_max_in_flight of them may
+     * wait for their response at any time. They are completed in the same
+     * order, so promises are always fulfilled in the order of push().
+     */
+    void loop() {
+        std::shared_ptr<ProducerBatch>             open_batch;
+        std::deque<std::shared_ptr<ProducerBatch>> ready;
+        std::deque<std::shared_ptr<ProducerBatch>> in_flight;
+        size_t                                     drained_bytes = 0;
+        PendingEvent                               event;
+        while(true) {
+            // drain the ring into batches, keeping at most
+            // m_max_batch full batches waiting to be sent
+            bool drained = false;
+            while(ready.size() < m_max_batch.value && m_ring.tryPop(event)) {
+                drained = true;
+                if(!open_batch) open_batch = getNewBatch();
+                drained_bytes += event.byteSize();
+                if(event.serialized)
+                    open_batch->push(event.serialized_metadata, std::move(event.data), std::move(event.promise));
+                else
+                    open_batch->push(std::move(event.metadata), std::move(event.data), std::move(event.promise));
+                if(isFull(*open_batch))
+                    ready.push_back(std::move(open_batch));
+            }
+            if(drained) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(m_waiting_pushers.load(std::memory_order_relaxed) != 0) {
+                    std::unique_lock<thallium::mutex> guard{m_mutex};
+                    m_space_cv.notify_all();
+                }
+            }
+            if(open_batch && isReadyToSend(*open_batch))
+                ready.push_back(std::move(open_batch));
+            if(!ready.empty() && in_flight.size() < m_max_in_flight) {
+                auto batch = std::move(ready.front());
+                ready.pop_front();
+                m_queued_events.fetch_sub(batch->count(), std::memory_order_relaxed);
+                m_queued_bytes.fetch_sub(batch->byteSize(), std::memory_order_relaxed);
+                batch->start();
+                in_flight.push_back(std::move(batch));
+                m_in_flight_batches.store(in_flight.size(), std::memory_order_relaxed);
+                continue;
+            }
+            if(!in_flight.empty()) {
+                // nothing else to send or too many batches in flight,
+                // complete the oldest one
+                auto batch = std::move(in_flight.front());
+                in_flight.pop_front();
+                batch->complete();
+                m_in_flight_batches.store(in_flight.size(), std::memory_order_relaxed);
+                m_reusable_batches.push_back(std::move(batch));
+                continue;
+            }
+            // nothing ready and nothing in flight
+            std::unique_lock<thallium::mutex> guard{m_mutex};
+            if((m_need_stop || m_request_flush) && !open_batch) {
+                if(!m_ring.empty()) {
+                    // an event is being pushed, wait for it
+                    guard.unlock();
+                    tl::thread::yield();
+                    continue;
+                }
                 if(m_request_flush) {
                     m_request_flush = false;
-                    m_cv.notify_one();
+                    m_flushed_cv.notify_all();
                 }
+                if(m_need_stop) break;
+                continue;
+            }
+            if(m_need_stop || m_request_flush) continue;
+            // tell pushers which event should wake us up
+            const auto no_limit = std::numeric_limits<size_t>::max();
+            const auto popped   = m_ring.popped();
+            size_t wake_at;
+            if(!open_batch && (m_batch_size == diaspora::BatchSize::Adaptive()
+                               || m_policy.linger.count() != 0))
+                wake_at = popped + 1;
+            else if(m_batch_size == diaspora::BatchSize::Adaptive())
+                wake_at = no_limit;
+            else
+                wake_at = popped + m_batch_size.value - (open_batch ? open_batch->count() : 0);
+            wake_at = std::min(wake_at, popped + m_ring.capacity()/2);
+            size_t wake_at_bytes = m_policy.max_bytes == 0 ? no_limit
+                : drained_bytes + m_policy.max_bytes - (open_batch ? open_batch->byteSize() : 0);
+            m_wake_at.store(wake_at, std::memory_order_relaxed);
+            m_wake_at_bytes.store(wake_at_bytes, std::memory_order_relaxed);
+            m_sender_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(m_ring.pushed() >= wake_at || m_pushed_bytes.load() >= wake_at_bytes) {
+                m_sender_sleeping.store(false, std::memory_order_relaxed);
+                guard.unlock();
+                tl::thread::yield();
                 continue;
             }
-            auto batch = m_batch_queue.front();
-            m_batch_queue.pop();
-            guard.unlock();
-            batch->send();
-            m_cv.notify_one();
-            guard.lock();
-            //m_reusable_batches.push_back(batch);
+            if(open_batch && m_policy.linger.count() != 0)
+                m_sender_cv.wait_until(guard, open_batch->firstPushTime() + m_policy.linger);
+            else
+                m_sender_cv.wait(guard);
+            m_sender_sleeping.store(false, std::memory_order_relaxed);
         }
         m_running = false;
         m_terminated.set_value();
@@ -176,14 +383,28 @@ class ActiveProducerBatchQueue {
     std::shared_ptr<diaspora::ThreadPoolInterface> m_thread_pool;
     diaspora::BatchSize                            m_batch_size;
     diaspora::MaxNumBatches                        m_max_batch;
-    std::queue<std::shared_ptr<ProducerBatch>>     m_batch_queue;
-    //std::list<SP<ProducerBatchInterface>>          m_reusable_batches;
-    thallium::managed<thallium::thread>            m_sender_ult;
-    bool                                           m_need_stop = false;
-    bool                                           m_request_flush = false;
+    size_t                                         m_max_in_flight = 1;
+    BatchingPolicy                                 m_policy;
+    MPSCRingBuffer<PendingEvent>                   m_ring;
+    std::vector<std::shared_ptr<ProducerBatch>>    m_reusable_batches;
+    /* wake-up protocol between pushers and the sender */
+    std::atomic<bool>                              m_sender_sleeping = false;
+    std::atomic<size_t>                            m_wake_at = 0;
+    std::atomic<size_t>                            m_wake_at_bytes = 0;
+    std::atomic<size_t>                            m_pushed_bytes = 0;
+    std::atomic<size_t>                            m_waiting_pushers = 0;
+    /* statistics */
+    std::atomic<size_t>                            m_queued_events = 0;
+    std::atomic<size_t>                            m_queued_bytes = 0;
+    std::atomic<size_t>                            m_in_flight_batches = 0;
+    /* m_need_stop and m_request_flush are written with m_mutex held */
+    std::atomic<bool>                              m_need_stop = false;
+    std::atomic<bool>                              m_request_flush = false;
     std::atomic<bool>                              m_running = false;
     thallium::mutex                                m_mutex;
-    thallium::condition_variable                   m_cv;
+    thallium::condition_variable                   m_sender_cv;
+    thallium::condition_variable                   m_space_cv;
+    thallium::condition_variable                   m_flushed_cv;
     thallium::eventual<void>                       m_terminated;
 
 };
@@ -0,0 +1,192 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <mofka/Compression.hpp>
+
+#include <diaspora/Exception.hpp>
+
+#include <fmt/format.h>
+#include <cstring>
+#include <string>
+
+#ifdef MOFKA_HAS_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+#ifdef MOFKA_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mofka {
+
+CompressionConfig CompressionConfig::FromMetadata(const diaspora::Metadata& md) {
+    CompressionConfig config;
+    const auto& json = md.json();
+    if(json.is_null() || (json.is_object() && json.empty()))
+        return config;
+    if(!json.is_object())
+        throw diaspora::Exception{"\"compression\" should be an object"};
+    if(json.contains("codec")) {
+        if(!json["codec"].is_string())
+            throw diaspora::Exception{"\"compression.codec\" should be a string"};
+        auto codec = json["codec"].get<std::string>();
+        if(codec == "none")      config.codec = CompressionCodec::None;
+        else if(codec == "lz4")  config.codec = CompressionCodec::LZ4;
+        else if(codec == "zstd") config.codec = CompressionCodec::Zstd;
+        else throw diaspora::Exception{
+            fmt::format("Unknown compression codec \"{}\"", codec)};
+    }
+    if(json.contains("level")) {
+        if(!json["level"].is_number_integer())
+            throw diaspora::Exception{"\"compression.level\" should be an integer"};
+        config.level = json["level"].get<int>();
+    }
+    return config;
+}
+
+diaspora::Metadata CompressionConfig::toMetadata() const {
+    auto json = nlohmann::json::object();
+    switch(codec) {
+        case CompressionCodec::None: json["codec"] = "none"; break;
+        case CompressionCodec::LZ4:  json["codec"] = "lz4";  break;
+        case CompressionCodec::Zstd: json["codec"] = "zstd"; break;
+    }
+    json["level"] = level;
+    return diaspora::Metadata{std::move(json)};
+}
+
+bool CompressionConfig::IsAvailable(CompressionCodec codec) {
+    switch(codec) {
+        case CompressionCodec::None:
+            return true;
+        case CompressionCodec::LZ4:
+#ifdef MOFKA_HAS_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case CompressionCodec::Zstd:
+#ifdef MOFKA_HAS_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+#ifdef MOFKA_HAS_LZ4
+/* an LZ4 sequence encodes at most 255 bytes of match length per byte */
+static constexpr size_t LZ4_MAX_RATIO = 255;
+#endif
+#ifdef MOFKA_HAS_ZSTD
+/* a Zstd block decodes to at most 128 KiB and takes at least 4 bytes
+ * (a 3-byte header and one RLE byte) */
+static constexpr size_t ZSTD_MAX_RATIO = (128*1024) / 4;
+#endif
+
+static void ThrowUnavailable(CompressionCodec codec) {
+    throw diaspora::Exception{fmt::format(
+        "Mofka was built without support for compression codec {}",
+        static_cast<int>(codec))};
+}
+
+void CompressAppend(const CompressionConfig& config,
+                    const char* data, size_t size,
+                    std::vector<char>& output) {
+    const size_t header_offset = output.size();
+    output.resize(header_offset + sizeof(size));
+    std::memcpy(output.data() + header_offset, &size, sizeof(size));
+    const size_t offset = output.size();
+    switch(config.codec) {
+        case CompressionCodec::None: {
+            output.insert(output.end(), data, data + size);
+            return;
+        }
+        case CompressionCodec::LZ4: {
+#ifdef MOFKA_HAS_LZ4
+            auto bound = LZ4_compressBound((int)size);
+            output.resize(offset + bound);
+            int ret = config.level > 0
+                ? LZ4_compress_HC(data, output.data() + offset, (int)size, bound, config.level)
+                : LZ4_compress_default(data, output.data() + offset, (int)size, bound);
+            if(ret <= 0 && size != 0)
+                throw diaspora::Exception{"LZ4 compression failed"};
+            output.resize(offset + ret);
+            return;
+#else
+            break;
+#endif
+        }
+        case CompressionCodec::Zstd: {
+#ifdef MOFKA_HAS_ZSTD
+            auto bound = ZSTD_compressBound(size);
+            output.resize(offset + bound);
+            auto ret = ZSTD_compress(output.data() + offset, bound, data, size, config.level);
+            if(ZSTD_isError(ret))
+                throw diaspora::Exception{fmt::format(
+                    "Zstd compression failed: {}", ZSTD_getErrorName(ret))};
+            output.resize(offset + ret);
+            return;
+#else
+            break;
+#endif
+        }
+    }
+    ThrowUnavailable(config.codec);
+}
+
+void Decompress(CompressionCodec codec,
+                const char* data, size_t size,
+                std::vector<char>& output) {
+    size_t original_size;
+    if(size < sizeof(original_size))
+        throw diaspora::Exception{"Invalid compressed block (too small)"};
+    std::memcpy(&original_size, data, sizeof(original_size));
+    data += sizeof(original_size);
+    size -= sizeof(original_size);
+    // the size header comes from the block itself, so it is checked against
+    // what the codec can produce from size bytes before allocating output
+    switch(codec) {
+        case CompressionCodec::None: {
+            if(size != original_size)
+                throw diaspora::Exception{"Invalid uncompressed block (size mismatch)"};
+            output.resize(original_size);
+            std::memcpy(output.data(), data, size);
+            return;
+        }
+        case CompressionCodec::LZ4: {
+#ifdef MOFKA_HAS_LZ4
+            if(original_size > (size_t)LZ4_MAX_INPUT_SIZE
+            || original_size > size*LZ4_MAX_RATIO)
+                throw diaspora::Exception{"Invalid LZ4 block (size header too large)"};
+            output.resize(original_size);
+            int ret = LZ4_decompress_safe(data, output.data(), (int)size, (int)original_size);
+            if(ret < 0 || (size_t)ret != original_size)
+                throw diaspora::Exception{"LZ4 decompression failed"};
+            return;
+#else
+            break;
+#endif
+        }
+        case CompressionCodec::Zstd: {
+#ifdef MOFKA_HAS_ZSTD
+            if(ZSTD_getFrameContentSize(data, size) != original_size
+            || original_size > size*ZSTD_MAX_RATIO)
+                throw diaspora::Exception{"Invalid Zstd block (size header mismatch)"};
+            output.resize(original_size);
+            auto ret = ZSTD_decompress(output.data(), original_size, data, size);
+            if(ZSTD_isError(ret) || ret != original_size)
+                throw diaspora::Exception{"Zstd decompression failed"};
+            return;
+#else
+            break;
+#endif
+        }
+    }
+    ThrowUnavailable(codec);
+}
+
+}
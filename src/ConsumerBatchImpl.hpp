@@ -12,6 +12,7 @@
 #include <mofka/Promise.hpp>
 #include <mofka/MofkaPartitionInfo.hpp>
 #include <mofka/MofkaConsumer.hpp>
+#include <mofka/MofkaEvent.hpp>
 
 #include <diaspora/EventID.hpp>
 #include <diaspora/Metadata.hpp>
@@ -20,10 +21,21 @@
 #include <diaspora/DataView.hpp>
 #include <diaspora/Future.hpp>
 #include <diaspora/Consumer.hpp>
+#include <diaspora/Exception.hpp>
+#include <diaspora/BufferWrapperArchive.hpp>
 
 #include <thallium.hpp>
+#include <thallium/bulk_buffer_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
@@ -34,70 +46,182 @@ class MofkaConsumer;
 class ConsumerBatchImpl {
 
     friend class MofkaConsumer;
-
-    thallium::engine    m_engine;
-    std::vector<size_t> m_meta_sizes;       /* size of each serialized metadata object */
-    std::vector<char>   m_meta_buffer;      /* packed serialized metadata objects */
-    std::vector<size_t> m_data_desc_sizes;  /* size of the data descriptors associated with each metadata */
-    std::vector<char>   m_data_desc_buffer; /* packed data descriptors */
+    friend class MofkaEventBatch;
+
+    /* The four regions below are carved out of a single buffer of the
+     * consumer's receive pool, which is registered for RDMA once. m_pool is
+     * declared first so that it outlives m_buffer. */
+    std::shared_ptr<thallium::bulk_buffer_pool<>> m_pool;
+    thallium::bulk_buffer<>                       m_buffer;
+    size_t                                        m_offsets[4] = {0, 0, 0, 0};
+    std::span<size_t>   m_meta_sizes;       /* size of each serialized metadata object */
+    std::span<char>     m_meta_buffer;      /* packed serialized metadata objects */
+    std::span<size_t>   m_data_desc_sizes;  /* size of the data descriptors associated with each metadata */
+    std::span<char>     m_data_desc_buffer; /* packed data descriptors */
+
+    /* fields below are set by prepare() once the batch has been pulled */
+    diaspora::EventID                          m_first_id = 0;
+    std::shared_ptr<MofkaPartitionInfo>        m_partition;
+    diaspora::Serializer                       m_serializer;
+    std::vector<size_t>                        m_meta_offsets;   /* offset of each metadata in m_meta_buffer */
+    std::vector<diaspora::Metadata>            m_metadata;       /* deserialized by metadata(i) */
+    std::unique_ptr<std::once_flag[]>          m_metadata_once;
+    std::vector<Result<diaspora::DataView>>    m_data;
+    std::string                                m_consumer_name;
+    std::optional<thallium::remote_procedure>  m_ack_rpc;
+
+    /* number of events not yet handed to the application, and
+     * function to call when it reaches 0 (to give back a credit) */
+    std::atomic<size_t>                        m_undelivered{0};
+    std::function<void()>                      m_on_delivered;
 
     public:
 
-    ConsumerBatchImpl(thallium::engine engine, size_t count, size_t metadata_size, size_t data_desc_size)
-    : m_engine(std::move(engine))
-    , m_meta_sizes(count)
-    , m_meta_buffer(metadata_size)
-    , m_data_desc_sizes(count)
-    , m_data_desc_buffer(data_desc_size) {}
+    ConsumerBatchImpl(std::shared_ptr<thallium::bulk_buffer_pool<>> pool,
+                      size_t count, size_t metadata_size, size_t data_desc_size)
+    : m_pool(std::move(pool)) {
+        const size_t sizes_bytes = count*sizeof(size_t);
+        m_offsets[0] = 0;
+        m_offsets[1] = sizes_bytes;
+        m_offsets[2] = AlignUp(m_offsets[1] + metadata_size, alignof(size_t));
+        m_offsets[3] = m_offsets[2] + sizes_bytes;
+        const size_t total = m_offsets[3] + data_desc_size;
+        m_buffer = m_pool->get(std::max<size_t>(total, 1), /*extend_if_needed=*/true);
+        auto base = static_cast<char*>(m_buffer.data());
+        m_meta_sizes       = {reinterpret_cast<size_t*>(base + m_offsets[0]), count};
+        m_meta_buffer      = {base + m_offsets[1], metadata_size};
+        m_data_desc_sizes  = {reinterpret_cast<size_t*>(base + m_offsets[2]), count};
+        m_data_desc_buffer = {base + m_offsets[3], data_desc_size};
+    }
 
-    ConsumerBatchImpl(ConsumerBatchImpl&&) = default;
+    ConsumerBatchImpl(ConsumerBatchImpl&&) = delete;
     ConsumerBatchImpl(const ConsumerBatchImpl&) = delete;
-    ConsumerBatchImpl& operator=(ConsumerBatchImpl&&) = default;
-    ConsumerBatchImpl& operator=(const ConsumerBatchImpl&) = default;
+    ConsumerBatchImpl& operator=(ConsumerBatchImpl&&) = delete;
+    ConsumerBatchImpl& operator=(const ConsumerBatchImpl&) = delete;
     ~ConsumerBatchImpl() = default;
 
-    void pullFrom(const BulkRef& remote_meta_sizes,
+    /**
+     * @brief Pulls the four regions of the batch from the process that fed it.
+     * A region is pulled in the same RDMA operation as the previous one when
+     * they are contiguous both locally and remotely, and the BulkRef of the
+     * second one has shares_previous_handle set, as the partition managers
+     * do for the contents that follow their sizes. lookup(address) should
+     * return the endpoint for an address.
+     */
+    template<typename Lookup>
+    void pullFrom(Lookup&& lookup,
+                  const BulkRef& remote_meta_sizes,
                   const BulkRef& remote_meta_buffer,
                   const BulkRef& remote_desc_sizes,
                   const BulkRef& remote_desc_buffer) {
-        std::vector<std::pair<void*, size_t>> segments = {
-            {m_meta_sizes.data(), m_meta_sizes.size()*sizeof(m_meta_sizes[0])},
-            {m_meta_buffer.data(), m_meta_buffer.size()*sizeof(m_meta_buffer[0])},
-            {m_data_desc_sizes.data(), m_data_desc_sizes.size()*sizeof(m_data_desc_sizes[0])},
-            {m_data_desc_buffer.data(), m_data_desc_buffer.size()*sizeof(m_data_desc_buffer[0])}
+        const BulkRef* remote[4] = {
+            &remote_meta_sizes, &remote_meta_buffer,
+            &remote_desc_sizes, &remote_desc_buffer
         };
-        auto local_bulk = m_engine.expose(segments, thallium::bulk_mode::write_only);
-        size_t local_offset = 0;
-        auto pull_bulk_ref = [](thallium::bulk& local,
-                                size_t local_offset,
-                                thallium::endpoint& ep,
-                                const BulkRef& remote) {
-            if(remote.size == 0) return;
-            local(local_offset, remote.size) << remote.handle.on(ep)(remote.offset, remote.size);
-        };
-        // transfer metadata sizes
-        thallium::endpoint remote_ep = m_engine.lookup(remote_meta_sizes.address);
-        pull_bulk_ref(local_bulk, local_offset, remote_ep, remote_meta_sizes);
-        local_offset += segments[0].second;
-        // transfer metadata
-        if(remote_meta_buffer.address != remote_meta_sizes.address)
-            remote_ep = m_engine.lookup(remote_meta_buffer.address);
-        pull_bulk_ref(local_bulk, local_offset, remote_ep, remote_meta_buffer);
-        local_offset += segments[1].second;
-        // transfer data descriptor sizes
-        if(remote_desc_sizes.address != remote_meta_buffer.address)
-            remote_ep = m_engine.lookup(remote_desc_sizes.address);
-        pull_bulk_ref(local_bulk, local_offset, remote_ep, remote_desc_sizes);
-        local_offset += segments[2].second;
-        // transfer data descriptors
-        if(remote_desc_buffer.address != remote_desc_sizes.address)
-            remote_ep = m_engine.lookup(remote_desc_buffer.address);
-        pull_bulk_ref(local_bulk, local_offset, remote_ep, remote_desc_buffer);
+        size_t i = 0;
+        while(i < 4) {
+            size_t size = remote[i]->size;
+            size_t j = i + 1;
+            for(; j < 4; ++j) {
+                if(m_offsets[j-1] + remote[j-1]->size != m_offsets[j]) break;
+                if(!Contiguous(*remote[j-1], *remote[j])) break;
+                size += remote[j]->size;
+            }
+            if(size != 0) {
+                thallium::endpoint remote_ep = lookup(remote[i]->address);
+                m_buffer.bulk()(m_offsets[i], size)
+                    << remote[i]->handle.on(remote_ep)(remote[i]->offset, size);
+            }
+            i = j;
+        }
     }
 
     size_t count() const {
         return m_meta_sizes.size();
     }
+
+    /**
+     * @brief Sets up the per-event state of a batch that has been pulled.
+     */
+    void prepare(diaspora::EventID first_id,
+                 std::shared_ptr<MofkaPartitionInfo> partition,
+                 diaspora::Serializer serializer,
+                 std::string consumer_name,
+                 thallium::remote_procedure ack_rpc) {
+        m_first_id      = first_id;
+        m_partition     = std::move(partition);
+        m_serializer    = std::move(serializer);
+        m_consumer_name = std::move(consumer_name);
+        m_ack_rpc       = std::move(ack_rpc);
+        const size_t n  = count();
+        m_meta_offsets.resize(n);
+        size_t offset = 0;
+        for(size_t i = 0; i < n; ++i) {
+            m_meta_offsets[i] = offset;
+            offset += m_meta_sizes[i];
+        }
+        m_metadata.resize(n);
+        m_metadata_once = std::make_unique<std::once_flag[]>(n);
+        m_data.resize(n);
+        m_undelivered = n;
+    }
+
+    /**
+     * @brief Records that count events of the batch have been handed to
+     * the application.
+     */
+    void delivered(size_t count) {
+        if(count == 0) return;
+        if(m_undelivered.fetch_sub(count) == count && m_on_delivered)
+            m_on_delivered();
+    }
+
+    /**
+     * @brief Returns the metadata of event i, deserializing it on first
+     * call. Throws a diaspora::Exception if it cannot be deserialized (in
+     * which case the next call will try again).
+     */
+    diaspora::Metadata& metadata(size_t i) {
+        std::call_once(m_metadata_once[i], [this, i]() {
+            diaspora::BufferWrapperInputArchive archive{std::string_view{
+                m_meta_buffer.data() + m_meta_offsets[i], m_meta_sizes[i]}};
+            m_serializer.deserialize(archive, m_metadata[i]);
+        });
+        return m_metadata[i];
+    }
+
+    /**
+     * @brief Creates a MofkaEvent for event i of the batch. The event keeps
+     * a reference to the batch's metadata buffer and deserializes its
+     * metadata on first access, unless metadata is provided.
+     */
+    static std::shared_ptr<MofkaEvent> MakeEvent(
+            const std::shared_ptr<ConsumerBatchImpl>& batch, size_t i,
+            diaspora::DataView data,
+            std::optional<diaspora::Metadata> metadata = std::nullopt) {
+        return std::make_shared<MofkaEvent>(
+            batch->m_first_id + i, batch->m_partition,
+            std::shared_ptr<const char>{
+                batch, batch->m_meta_buffer.data() + batch->m_meta_offsets[i]},
+            batch->m_meta_sizes[i],
+            batch->m_serializer,
+            std::move(data), batch->m_consumer_name, *batch->m_ack_rpc,
+            std::move(metadata));
+    }
+    private:
+
+    static size_t AlignUp(size_t x, size_t alignment) {
+        return (x + alignment - 1) / alignment * alignment;
+    }
+
+    /* Two regions of a batch can be pulled together when the feeder says
+     * the second one comes from the same bulk handle as the first, and
+     * it starts where the first one ends. */
+    static bool Contiguous(const BulkRef& a, const BulkRef& b) {
+        return b.shares_previous_handle
+            && a.offset + a.size == b.offset
+            && a.address == b.address;
+    }
 };
 
 }
@@ -8,6 +8,7 @@
 #include <mofka/Promise.hpp>
 
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <limits>
 
 namespace mofka {
@@ -20,6 +21,10 @@ bool ConsumerHandle::shouldStop() const {
     return self->m_should_stop;
 }
 
+bool ConsumerHandle::acquireCredit() {
+    return self->acquireCredit();
+}
+
 diaspora::Future<void> ConsumerHandle::feed(
     size_t count,
     diaspora::EventID firstID,
@@ -57,7 +62,29 @@ diaspora::Future<void> ConsumerHandle::feed(
 
 void ConsumerHandleImpl::stop() {
     m_should_stop = true;
+    {
+        std::unique_lock<thallium::mutex> guard{m_credits_mtx};
+        m_credits_cv.notify_all();
+    }
     m_topic_manager->wakeUp();
 }
 
+bool ConsumerHandleImpl::acquireCredit() {
+    if(m_max_batches == 0) return !m_should_stop;
+    std::unique_lock<thallium::mutex> guard{m_credits_mtx};
+    m_credits_cv.wait(guard, [this]() {
+        return m_credits > 0 || m_should_stop;
+    });
+    if(m_should_stop) return false;
+    m_credits -= 1;
+    return true;
+}
+
+void ConsumerHandleImpl::grantCredits(size_t count) {
+    if(m_max_batches == 0) return;
+    std::unique_lock<thallium::mutex> guard{m_credits_mtx};
+    m_credits = std::min(m_credits + count, m_max_batches);
+    m_credits_cv.notify_all();
+}
+
 }
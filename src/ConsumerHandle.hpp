@@ -91,6 +91,16 @@ class ConsumerHandle {
      */
     bool shouldStop() const;
 
+    /**
+     * @brief Takes one of the batch credits granted by the consumer,
+     * blocking until one is available. Feed loops should call it once
+     * they have events for a batch, before preparing it, so that no
+     * credit is held while waiting for events (the final empty batch
+     * marking the end of a partition does not take one). Returns false
+     * if the feeding should stop instead.
+     */
+    bool acquireCredit();
+
     /**
      * @brief Checks if the ConsumerHandle instance is valid.
      */
@@ -61,6 +61,13 @@ class ConsumerHandleImpl {
     const thallium::remote_procedure        m_send_batch;
     std::atomic<bool>                       m_should_stop = false;
 
+    /* Flow control: number of batches that can still be sent to the
+     * consumer before it grants more. Unlimited if m_max_batches is 0. */
+    const size_t                            m_max_batches;
+    size_t                                  m_credits;
+    thallium::mutex                         m_credits_mtx;
+    thallium::condition_variable            m_credits_cv;
+
     size_t m_sent_events = 0;
 
     ConsumerHandleImpl(
@@ -70,16 +77,23 @@ class ConsumerHandleImpl {
         size_t max,
         std::shared_ptr<PartitionManager> topic_manager,
         thallium::endpoint endpoint,
-        thallium::remote_procedure rpc)
+        thallium::remote_procedure rpc,
+        size_t max_batches = 0)
     : m_consumer_ptr(ptr)
     , m_partition_index(partition_index)
     , m_consumer_name(std::move(name))
     , m_max_events(max)
     , m_topic_manager(std::move(topic_manager))
     , m_consumer_endpoint(std::move(endpoint))
-    , m_send_batch(std::move(rpc)) {}
+    , m_send_batch(std::move(rpc))
+    , m_max_batches(max_batches)
+    , m_credits(max_batches) {}
 
     void stop();
+
+    bool acquireCredit();
+
+    void grantCredits(size_t count);
 };
 
 }
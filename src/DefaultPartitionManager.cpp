@@ -8,9 +8,11 @@
 #include <diaspora/DataDescriptor.hpp>
 #include <diaspora/BufferWrapperArchive.hpp>
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <numeric>
 #include <iostream>
 #include <cstring>
+#include <cerrno>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -39,8 +41,17 @@ DefaultPartitionManager::DefaultPartitionManager(
 , m_max_chunk_size(opts.max_chunk_size)
 , m_max_events_per_chunk(opts.max_events_per_chunk)
 , m_sync(opts.sync)
+, m_group_commit(opts.group_commit)
+, m_group_commit_max_batches(std::max(opts.group_commit_max_batches, (size_t)1))
+, m_group_commit_max_linger(opts.group_commit_max_linger_us)
+, m_write_pipeline_depth(std::max(opts.write_pipeline_depth, (size_t)1))
 , m_abt_io(opts.abt_io)
 , m_fd_cache(opts.abt_io, opts.fd_cache_capacity)
+, m_mmap_cache(opts.mmap_cache_max_bytes)
+, m_max_read_size(std::max(opts.max_read_size, (size_t)1))
+, m_write_cache(opts.write_cache,
+                opts.write_cache_max_batches,
+                opts.write_cache_max_memory_bytes)
 , m_engine(std::move(engine))
 , m_metadata_buffer_pool(m_engine,
                           opts.metadata_pool_num_tiers,
@@ -66,6 +77,15 @@ DefaultPartitionManager::DefaultPartitionManager(
                           opts.consumer_desc_pool_first_size,
                           opts.consumer_desc_pool_size_multiple,
                           thallium::bulk_mode::read_only)
+, m_consumer_data_buffer_pool(m_engine,
+                          opts.consumer_data_pool_num_tiers,
+                          opts.consumer_data_pool_num_buffers,
+                          opts.consumer_data_pool_first_size,
+                          opts.consumer_data_pool_size_multiple,
+                          thallium::bulk_mode::read_only)
+, m_ack_early(opts.ack_early)
+, m_ack_early_max_pending_batches(std::max(opts.ack_early_max_pending_batches, (size_t)1))
+, m_ack_early_max_pending_bytes(opts.ack_early_max_pending_bytes)
 {
     m_write_ult = m_engine.get_handler_pool().make_thread([this]() { writeLoop(); });
 }
@@ -85,20 +105,17 @@ void DefaultPartitionManager::openChunk(uint32_t chunk_id) {
         }
         return fd;
     };
-    m_fd_meta = open_file(chunkPath(chunk_id, "meta"));
-    m_fd_data = open_file(chunkPath(chunk_id, "data"));
-    m_fd_desc = open_file(chunkPath(chunk_id, "desc"));
-    m_fd_idx  = open_file(chunkPath(chunk_id, "idx"));
+    auto chunk = std::make_shared<ChunkFiles>(chunk_id);
+    chunk->fd_meta = open_file(chunkPath(chunk_id, "meta"));
+    chunk->fd_data = open_file(chunkPath(chunk_id, "data"));
+    chunk->fd_desc = open_file(chunkPath(chunk_id, "desc"));
+    chunk->fd_idx  = open_file(chunkPath(chunk_id, "idx"));
+    m_chunk = std::move(chunk);
 }
 
 void DefaultPartitionManager::closeCurrentChunk() {
-    // Use POSIX close() instead of abt_io_close() because this may be called
-    // during destructor teardown when ABT pools are already destroyed.
-    // All data has been flushed via abt_io_fdatasync() during normal operation.
-    if(m_fd_meta >= 0) { ::close(m_fd_meta); m_fd_meta = -1; }
-    if(m_fd_data >= 0) { ::close(m_fd_data); m_fd_data = -1; }
-    if(m_fd_desc >= 0) { ::close(m_fd_desc); m_fd_desc = -1; }
-    if(m_fd_idx  >= 0) { ::close(m_fd_idx);  m_fd_idx  = -1; }
+    // The files are closed once the last in-flight write targeting them completes
+    m_chunk.reset();
 }
 
 void DefaultPartitionManager::rotateChunk() {
@@ -127,226 +144,616 @@ DefaultPartitionManager::~DefaultPartitionManager() {
     }
     m_write_ult->join();
     closeCurrentChunk();
+    if(m_write_cache.enabled()) {
+        auto stats = writeCacheStats();
+        spdlog::info("[mofka] Write cache stats: feed hits={}, feed misses={}, "
+                     "getData hits={}, getData misses={}",
+                     stats.feed_hits, stats.feed_misses,
+                     stats.getdata_hits, stats.getdata_misses);
+    }
 }
 
 void DefaultPartitionManager::writeLoop() {
+    // Writes are issued in order and completed in order. While the I/O of
+    // up to m_write_pipeline_depth writes is in flight, the loop moves on to
+    // serializing the descriptors of the next operations. Operations are
+    // only queued once their transfers have succeeded.
+    std::deque<std::unique_ptr<PendingWrite>> in_flight;
+    std::deque<std::unique_ptr<PendingWrite>> prepared;
+    PushOperationGroup group;
+
+    auto complete_oldest = [this, &in_flight]() {
+        completeWrite(*in_flight.front());
+        in_flight.pop_front();
+        m_events_cv.notify_all();
+    };
+
     while(true) {
-        std::shared_ptr<PushOperation> op;
+        group.clear();
         {
             auto g = std::unique_lock<thallium::mutex>{m_write_queue_mtx};
+            // Don't go to sleep on an empty queue with writes still in flight
+            while(m_write_queue.empty() && !m_stop && !in_flight.empty()) {
+                g.unlock();
+                complete_oldest();
+                g.lock();
+            }
             m_write_queue_cv.wait(g, [this]() {
                 return !m_write_queue.empty() || m_stop;
             });
             if(m_write_queue.empty()) break;
+            group.push_back(std::move(m_write_queue.front()));
+            m_write_queue.pop_front();
+        }
+        if(m_group_commit) collectGroup(group);
+        prepareWrites(group, prepared);
+        while(!prepared.empty()) {
+            while(in_flight.size() >= m_write_pipeline_depth)
+                complete_oldest();
+            issueWrite(*prepared.front());
+            in_flight.push_back(std::move(prepared.front()));
+            prepared.pop_front();
+        }
+    }
+
+    while(!in_flight.empty())
+        complete_oldest();
+}
+
+void DefaultPartitionManager::collectGroup(PushOperationGroup& group) {
+    // Operations are popped in queue order, which is also the order in
+    // which their event IDs were assigned, so the group is contiguous.
+    auto deadline = std::chrono::steady_clock::now() + m_group_commit_max_linger;
+    while(group.size() < m_group_commit_max_batches) {
+        std::shared_ptr<PushOperation> op;
+        {
+            auto g = std::unique_lock<thallium::mutex>{m_write_queue_mtx};
+            while(m_write_queue.empty() && !m_stop
+               && std::chrono::steady_clock::now() < deadline) {
+                m_write_queue_cv.wait_until(g, deadline);
+            }
+            if(m_write_queue.empty()) break;
             op = std::move(m_write_queue.front());
             m_write_queue.pop_front();
         }
-        op->waitTransfers();
-        Result<diaspora::EventID> result;
-        try {
-            op->writeToFiles();
-            result.value() = op->m_first_id;
-        } catch(const std::exception& ex) {
-            result.success() = false;
-            result.error() = ex.what();
+        group.push_back(std::move(op));
+    }
+}
+
+void DefaultPartitionManager::prepareWrites(
+        const PushOperationGroup& group,
+        std::deque<std::unique_ptr<PendingWrite>>& writes) {
+    // Split the group into runs that fit in the current chunk: a run ends
+    // with the first operation after which the chunk must be rotated.
+    size_t begin = 0;
+    while(begin < group.size()) {
+        size_t   end         = begin;
+        uint64_t meta_offset = m_meta_offset;
+        uint64_t data_offset = m_data_offset;
+        size_t   num_events  = m_events_in_current_chunk;
+        while(end < group.size()) {
+            auto& op = group[end++];
+            meta_offset += op->m_metadata_content.size();
+            data_offset += op->m_data_content.size();
+            num_events  += op->m_num_events;
+            if(num_events >= m_max_events_per_chunk
+            || meta_offset + data_offset >= m_max_chunk_size)
+                break;
         }
-        op->sendResponse(result);
-        m_events_cv.notify_all();
+        writes.push_back(prepareWrite(group, begin, end));
+        begin = end;
     }
 }
 
-void DefaultPartitionManager::PushOperation::writeToFiles()
+std::unique_ptr<DefaultPartitionManager::PendingWrite>
+DefaultPartitionManager::prepareWrite(
+        const PushOperationGroup& group, size_t begin, size_t end)
 {
-    auto& mgr = m_manager;
+    auto write = std::make_unique<PendingWrite>();
+    write->m_ops.assign(group.begin() + begin, group.begin() + end);
+    write->m_op_errors.resize(write->m_ops.size());
+
+    size_t num_events = 0;
+    for(auto& op : write->m_ops)
+        num_events += op->m_num_events;
+
+    if(!m_chunk) {
+        // A previous rotation failed to open the chunk: try again, so that
+        // only the runs prepared while it can't be opened are lost.
+        try {
+            openChunk(m_current_chunk_id);
+        } catch(const std::exception& ex) {
+            // The run's IDs are already assigned: publish them as tombstones.
+            // Their slots in the .idx file are skipped, so that the file is
+            // zero-filled there and the IDs after them stay aligned.
+            write->m_error = ex.what();
+            write->m_records.resize(num_events);
+            m_events_in_current_chunk += num_events;
+            return write;
+        }
+    }
 
-    std::vector<IndexRecord> records(m_num_events);
-    std::vector<char>        desc_buf;
+    auto& records  = write->m_records;
+    auto& desc_buf = write->m_desc_buf;
+    records.reserve(num_events);
 
-    uint64_t meta_off = mgr.m_meta_offset;
-    uint64_t data_off = mgr.m_data_offset;
+    write->m_chunk       = m_chunk;
+    write->m_meta_offset = m_meta_offset;
+    write->m_data_offset = m_data_offset;
+    write->m_desc_offset = m_desc_offset;
+    write->m_idx_offset  = m_events_in_current_chunk * sizeof(IndexRecord);
+
+    uint64_t meta_off = m_meta_offset;
+    uint64_t data_off = m_data_offset;
+    uint64_t desc_off = m_desc_offset;
 
     {
         diaspora::BufferWrapperOutputArchive output_archive{desc_buf};
-        for(size_t i = 0; i < m_num_events; ++i) {
-            records[i].metadata_offset  = meta_off;
-            records[i].metadata_size    = static_cast<uint32_t>(m_metadata_sizes[i]);
-            records[i].data_offset      = data_off;
-            records[i].data_size        = static_cast<uint32_t>(m_data_sizes[i]);
-            records[i].data_desc_offset = mgr.m_desc_offset;
-
-            FileDataDescriptor fdd;
-            fdd.chunk_id = mgr.m_current_chunk_id;
-            fdd.offset   = data_off;
-            fdd.size     = static_cast<uint32_t>(m_data_sizes[i]);
-
-            auto data_descriptor = diaspora::DataDescriptor(fdd.toString(), fdd.size);
-            size_t desc_before = desc_buf.size();
-            data_descriptor.save(output_archive);
-            size_t desc_size = desc_buf.size() - desc_before;
-
-            records[i].data_desc_size = static_cast<uint32_t>(desc_size);
-
-            meta_off += m_metadata_sizes[i];
-            data_off += m_data_sizes[i];
-            mgr.m_desc_offset += desc_size;
+        for(auto& op : write->m_ops) {
+            for(size_t i = 0; i < op->m_num_events; ++i) {
+                IndexRecord record;
+                record.metadata_offset  = meta_off;
+                record.metadata_size    = static_cast<uint32_t>(op->m_metadata_sizes[i]);
+                record.data_offset      = data_off;
+                record.data_size        = static_cast<uint32_t>(op->m_data_sizes[i]);
+                record.data_desc_offset = desc_off;
+
+                FileDataDescriptor fdd;
+                fdd.chunk_id = m_current_chunk_id;
+                fdd.offset   = data_off;
+                fdd.size     = static_cast<uint32_t>(op->m_data_sizes[i]);
+
+                auto data_descriptor = diaspora::DataDescriptor(fdd.toString(), fdd.size);
+                size_t desc_before = desc_buf.size();
+                data_descriptor.save(output_archive);
+                size_t desc_size = desc_buf.size() - desc_before;
+
+                record.data_desc_size = static_cast<uint32_t>(desc_size);
+                records.push_back(record);
+
+                meta_off += op->m_metadata_sizes[i];
+                data_off += op->m_data_sizes[i];
+                desc_off += desc_size;
+            }
         }
     }
 
-    // Write metadata to .meta
-    if(!m_metadata_content.empty()) {
-        ssize_t ret = abt_io_pwrite(mgr.m_abt_io, mgr.m_fd_meta,
-            m_metadata_content.data(), m_metadata_content.size(), mgr.m_meta_offset);
-        if(ret < 0)
-            throw diaspora::Exception{fmt::format("Failed to write metadata: {}", strerror(-ret))};
+    // Advance the write cursor; the run's file regions are now reserved
+    m_meta_offset = meta_off;
+    m_data_offset = data_off;
+    m_desc_offset = desc_off;
+    m_events_in_current_chunk += num_events;
+
+    if(shouldRotate()) {
+        try {
+            rotateChunk();
+        } catch(const std::exception& ex) {
+            // m_chunk stays null and the next run retries opening it
+            spdlog::error("[mofka] {}", ex.what());
+        }
     }
 
-    // Write data to .data
-    if(!m_data_content.empty()) {
-        ssize_t ret = abt_io_pwrite(mgr.m_abt_io, mgr.m_fd_data,
-            m_data_content.data(), m_data_content.size(), mgr.m_data_offset);
-        if(ret < 0)
-            throw diaspora::Exception{fmt::format("Failed to write data: {}", strerror(-ret))};
+    return write;
+}
+
+void DefaultPartitionManager::issueWrite(PendingWrite& write) {
+    if(!write.m_error.empty()) return;
+
+    // The content of consecutive operations lands back-to-back in .meta and
+    // .data but lives in distinct pool buffers, so each operation gets its
+    // own pwrite. The .idx write is issued by completeWrite once the rest of
+    // the run is on disk, so that an index record never refers to bytes that
+    // have not been written.
+    auto& chunk = *write.m_chunk;
+    write.m_io_ops.reserve(2 * write.m_ops.size() + 1);
+    write.m_io_rets.reserve(2 * write.m_ops.size() + 1);
+    write.m_io_owners.reserve(2 * write.m_ops.size() + 1);
+
+    size_t owner = 0;
+    auto issue = [&](int fd, const void* buf, size_t size, uint64_t offset) {
+        write.m_io_owners.push_back(owner);
+        write.m_io_rets.push_back(0);
+        auto io_op = abt_io_pwrite_nb(m_abt_io, fd, buf, size, offset,
+                                      &write.m_io_rets.back());
+        if(io_op) write.m_io_ops.push_back(io_op);
+        else write.m_io_rets.back() = -EIO;
+    };
+
+    uint64_t meta_off = write.m_meta_offset;
+    uint64_t data_off = write.m_data_offset;
+    for(; owner < write.m_ops.size(); ++owner) {
+        auto& op = write.m_ops[owner];
+        if(!op->m_metadata_content.empty()) {
+            issue(chunk.fd_meta, op->m_metadata_content.data(),
+                  op->m_metadata_content.size(), meta_off);
+            meta_off += op->m_metadata_content.size();
+        }
+        if(!op->m_data_content.empty()) {
+            issue(chunk.fd_data, op->m_data_content.data(),
+                  op->m_data_content.size(), data_off);
+            data_off += op->m_data_content.size();
+        }
     }
+    if(!write.m_desc_buf.empty())
+        issue(chunk.fd_desc, write.m_desc_buf.data(),
+              write.m_desc_buf.size(), write.m_desc_offset);
+}
 
-    // Write descriptors to .desc
-    if(!desc_buf.empty()) {
-        ssize_t ret = abt_io_pwrite(mgr.m_abt_io, mgr.m_fd_desc,
-            desc_buf.data(), desc_buf.size(),
-            mgr.m_desc_offset - desc_buf.size());
-        if(ret < 0)
-            throw diaspora::Exception{fmt::format("Failed to write descriptors: {}", strerror(-ret))};
+void DefaultPartitionManager::completeWrite(PendingWrite& write)
+{
+    for(auto* io_op : write.m_io_ops) {
+        abt_io_op_wait(io_op);
+        abt_io_op_free(io_op);
     }
+    write.m_io_ops.clear();
+    for(size_t k = 0; k < write.m_io_rets.size(); ++k) {
+        auto ret = write.m_io_rets[k];
+        if(ret >= 0) continue;
+        auto owner = write.m_io_owners[k];
+        auto& error = owner < write.m_ops.size() ? write.m_op_errors[owner] : write.m_error;
+        if(error.empty())
+            error = fmt::format("Failed to write chunk file: {}", strerror(-ret));
+    }
+
+    // An operation whose content could not be written keeps its IDs, which
+    // the operations after it rely on, but its index records are zeroed:
+    // its events are published as empty tombstones.
+    auto tombstone = [&write](size_t op_index) {
+        auto first = write.m_records.begin();
+        for(size_t j = 0; j < op_index; ++j)
+            first += write.m_ops[j]->m_num_events;
+        std::fill(first, first + write.m_ops[op_index]->m_num_events, IndexRecord{});
+    };
+    for(size_t j = 0; j < write.m_ops.size(); ++j)
+        if(!write.m_op_errors[j].empty()) tombstone(j);
 
     // Write index records to .idx
-    {
-        ssize_t ret = abt_io_pwrite(mgr.m_abt_io, mgr.m_fd_idx,
-            records.data(),
-            m_num_events * sizeof(IndexRecord),
-            mgr.m_events_in_current_chunk * sizeof(IndexRecord));
+    if(write.m_error.empty()) {
+        ssize_t ret = abt_io_pwrite(m_abt_io, write.m_chunk->fd_idx,
+            write.m_records.data(),
+            write.numEvents() * sizeof(IndexRecord),
+            write.m_idx_offset);
         if(ret < 0)
-            throw diaspora::Exception{fmt::format("Failed to write index: {}", strerror(-ret))};
+            write.m_error = fmt::format("Failed to write index: {}", strerror(-ret));
     }
 
-    // Sync if configured
-    if(mgr.m_sync) {
-        abt_io_fdatasync(mgr.m_abt_io, mgr.m_fd_meta);
-        abt_io_fdatasync(mgr.m_abt_io, mgr.m_fd_data);
-        abt_io_fdatasync(mgr.m_abt_io, mgr.m_fd_desc);
-        abt_io_fdatasync(mgr.m_abt_io, mgr.m_fd_idx);
+    // Sync if configured (once for the whole run of operations)
+    if(write.m_error.empty() && m_sync) {
+        auto& chunk = *write.m_chunk;
+        for(int fd : {chunk.fd_meta, chunk.fd_data, chunk.fd_desc, chunk.fd_idx}) {
+            int ret = abt_io_fdatasync(m_abt_io, fd);
+            if(ret < 0) {
+                write.m_error = fmt::format("Failed to sync chunk file: {}", strerror(-ret));
+                break;
+            }
+        }
     }
 
-    // Update in-memory state
-    mgr.m_meta_offset = meta_off;
-    mgr.m_data_offset = data_off;
-    mgr.m_events_in_current_chunk += m_num_events;
+    // A run that failed as a whole is published as tombstones
+    if(!write.m_error.empty())
+        std::fill(write.m_records.begin(), write.m_records.end(), IndexRecord{});
 
+    // Publish the events; runs complete in the order they were prepared,
+    // so the index grows in event-ID order. The write cache is populated
+    // first so that consumers woken up by the publication find them there.
+    if(write.m_error.empty() && m_write_cache.enabled()) cacheWrite(write);
     {
-        auto g = std::unique_lock<thallium::mutex>{mgr.m_index_mtx};
-        for(size_t i = 0; i < m_num_events; ++i) {
-            mgr.m_index.push_back(records[i]);
-            mgr.m_event_chunk_ids.push_back(mgr.m_current_chunk_id);
-        }
+        auto chunk_id = write.m_chunk ? write.m_chunk->id : m_current_chunk_id;
+        auto g = std::unique_lock<thallium::mutex>{m_index_mtx};
+        m_index.insert(m_index.end(), write.m_records.begin(), write.m_records.end());
+        m_event_chunk_ids.insert(m_event_chunk_ids.end(), write.numEvents(), chunk_id);
     }
     {
-        auto g = std::unique_lock<thallium::mutex>{mgr.m_events_mtx};
-        mgr.m_total_events += m_num_events;
+        auto g = std::unique_lock<thallium::mutex>{m_events_mtx};
+        m_total_events += write.numEvents();
+    }
+    for(size_t j = 0; j < write.m_ops.size(); ++j)
+        if(write.error(j).empty())
+            write.m_ops[j]->changeState(PushOperation::State::stored);
+
+    // Release the backpressure slots of early-acknowledged operations
+    size_t released_batches = 0, released_bytes = 0;
+    for(size_t j = 0; j < write.m_ops.size(); ++j) {
+        auto& op = write.m_ops[j];
+        if(!op->m_ack_early) continue;
+        released_batches += 1;
+        released_bytes   += op->transferSize();
+        if(!write.error(j).empty())
+            spdlog::error("[mofka] Failed to store early-acknowledged batch "
+                          "of {} events starting at {}: {}",
+                          op->m_num_events, op->m_first_id, write.error(j));
+    }
+    if(released_batches) {
+        auto g = std::unique_lock<thallium::mutex>{m_pending_mtx};
+        m_pending_batches -= released_batches;
+        m_pending_bytes   -= released_bytes;
+        m_pending_cv.notify_all();
     }
 
-    if(mgr.shouldRotate())
-        mgr.rotateChunk();
+    size_t written_bytes = 0;
+    for(auto& op : write.m_ops)
+        written_bytes += op->transferSize();
+    m_unstored_ops.fetch_sub(write.m_ops.size(), std::memory_order_relaxed);
+    m_unstored_bytes.fetch_sub(written_bytes, std::memory_order_relaxed);
 
-    changeState(State::stored);
+    // Producers are only acknowledged once the whole run is durable
+    // (early-acknowledged ones already got their response)
+    for(size_t j = 0; j < write.m_ops.size(); ++j) {
+        Result<diaspora::EventID> result;
+        if(write.error(j).empty()) {
+            result.value() = write.m_ops[j]->m_first_id;
+        } else {
+            result.success() = false;
+            result.error() = write.error(j);
+        }
+        write.m_ops[j]->sendResponse(std::move(result));
+    }
 }
 
-DefaultPartitionManager::PendingReads DefaultPartitionManager::readMetadataFromDisk(
-        diaspora::EventID first_id, size_t count,
-        size_t* sizes_out, char* content_out) {
-    PendingReads pending{m_abt_io};
-    pending.m_ops.reserve(count);
-    pending.m_rets.reserve(count);
-    size_t buf_offset = 0;
-    FDCache::EntryPtr current_entry;
-    uint32_t current_chunk = UINT32_MAX;
-    for(size_t i = 0; i < count; ++i) {
-        auto& rec = m_index[first_id + i];
-        sizes_out[i] = rec.metadata_size;
-        auto chunk_id = m_event_chunk_ids[first_id + i];
-        if(chunk_id != current_chunk) {
-            current_entry = m_fd_cache.get(chunkPath(chunk_id, "meta"));
-            pending.m_entries.push_back(current_entry);
-            current_chunk = chunk_id;
-        }
-        if(current_entry && current_entry->fd >= 0) {
-            pending.m_rets.push_back(0);
-            pending.m_ops.push_back(
-                abt_io_pread_nb(m_abt_io, current_entry->fd, content_out + buf_offset,
-                                rec.metadata_size, rec.metadata_offset,
-                                &pending.m_rets.back()));
+void DefaultPartitionManager::cacheWrite(const PendingWrite& write) {
+    size_t record_offset = 0;
+    for(size_t j = 0; j < write.m_ops.size(); ++j) {
+        auto& op = write.m_ops[j];
+        size_t memory = op->m_metadata_content.size() + op->m_data_content.size();
+        if(!write.m_op_errors[j].empty() || memory > m_write_cache.m_max_memory_bytes) {
+            record_offset += op->m_num_events;
+            continue;
         }
-        buf_offset += rec.metadata_size;
+        auto batch = std::make_shared<WriteCache::CachedBatch>();
+        batch->first_id = op->m_first_id;
+        batch->chunk_id = write.m_chunk->id;
+        batch->records.assign(
+            write.m_records.begin() + record_offset,
+            write.m_records.begin() + record_offset + op->m_num_events);
+        record_offset += op->m_num_events;
+        if(batch->records.empty()) continue;
+        auto& first = batch->records.front();
+        auto& last  = batch->records.back();
+        batch->metadata_offset = first.metadata_offset;
+        batch->data_offset     = first.data_offset;
+        batch->desc_offset     = first.data_desc_offset;
+        batch->metadata.assign(op->m_metadata_content.begin(), op->m_metadata_content.end());
+        batch->data.assign(op->m_data_content.begin(), op->m_data_content.end());
+        auto desc_begin = write.m_desc_buf.begin() + (first.data_desc_offset - write.m_desc_offset);
+        auto desc_end   = write.m_desc_buf.begin()
+                        + (last.data_desc_offset + last.data_desc_size - write.m_desc_offset);
+        batch->descriptors.assign(desc_begin, desc_end);
+        m_write_cache.insert(std::move(batch));
     }
-    return pending;
 }
 
-DefaultPartitionManager::PendingReads DefaultPartitionManager::readDescriptorsFromDisk(
+void DefaultPartitionManager::readRecordsFromCache(
+        const std::vector<WriteCache::CachedBatchPtr>& batches,
         diaspora::EventID first_id, size_t count,
+        size_t* meta_sizes_out, char* meta_content_out,
+        size_t* desc_sizes_out, char* desc_content_out) {
+    size_t meta_cursor = 0;
+    size_t desc_cursor = 0;
+    for(auto& batch : batches) {
+        auto begin = std::max(first_id, batch->first_id);
+        auto end   = std::min(first_id + count, batch->first_id + batch->numEvents());
+        if(begin >= end) continue;
+        // Events of a batch are stored back-to-back, so the requested range
+        // is a single contiguous region of each cached buffer
+        auto& first = batch->records[begin - batch->first_id];
+        size_t meta_size = 0, desc_size = 0;
+        for(auto id = begin; id < end; ++id) {
+            auto& rec = batch->records[id - batch->first_id];
+            meta_sizes_out[id - first_id] = rec.metadata_size;
+            desc_sizes_out[id - first_id] = rec.data_desc_size;
+            meta_size += rec.metadata_size;
+            desc_size += rec.data_desc_size;
+        }
+        std::memcpy(meta_content_out + meta_cursor,
+                    batch->metadata.data() + (first.metadata_offset - batch->metadata_offset),
+                    meta_size);
+        std::memcpy(desc_content_out + desc_cursor,
+                    batch->descriptors.data() + (first.data_desc_offset - batch->desc_offset),
+                    desc_size);
+        meta_cursor += meta_size;
+        desc_cursor += desc_size;
+    }
+}
+
+DefaultPartitionManager::PendingReads DefaultPartitionManager::readRecordsFromDisk(
+        const IndexRange& range,
+        const char* ext,
+        uint64_t IndexRecord::* offset_field,
+        uint32_t IndexRecord::* size_field,
         size_t* sizes_out, char* content_out) {
+    auto& records = range.records;
+    auto& chunk_ids = range.chunk_ids;
+    size_t count = records.size();
     PendingReads pending{m_abt_io};
     pending.m_ops.reserve(count);
     pending.m_rets.reserve(count);
+    pending.m_sizes.reserve(count);
+    // Runs complete in order, so every chunk before the one holding the last
+    // published event is sealed: its files will never be written again.
     size_t buf_offset = 0;
-    FDCache::EntryPtr current_entry;
-    uint32_t current_chunk = UINT32_MAX;
-    for(size_t i = 0; i < count; ++i) {
-        auto& rec = m_index[first_id + i];
-        sizes_out[i] = rec.data_desc_size;
-        auto chunk_id = m_event_chunk_ids[first_id + i];
-        if(chunk_id != current_chunk) {
-            current_entry = m_fd_cache.get(chunkPath(chunk_id, "desc"));
-            pending.m_entries.push_back(current_entry);
-            current_chunk = chunk_id;
+    size_t i = 0;
+    while(i < count) {
+        // Find the run of events [i, j) stored in the same chunk
+        auto chunk_id = chunk_ids[i];
+        size_t run_size = 0;
+        size_t j = i;
+        for(; j < count && chunk_ids[j] == chunk_id; ++j) {
+            sizes_out[j] = records[j].*size_field;
+            run_size    += sizes_out[j];
         }
-        if(current_entry && current_entry->fd >= 0) {
-            pending.m_rets.push_back(0);
-            pending.m_ops.push_back(
-                abt_io_pread_nb(m_abt_io, current_entry->fd, content_out + buf_offset,
-                                rec.data_desc_size, rec.data_desc_offset,
-                                &pending.m_rets.back()));
+        auto path = chunkPath(chunk_id, ext);
+        auto& first = records[i];
+        auto& last  = records[j - 1];
+        uint64_t range_begin = first.*offset_field;
+        uint64_t range_end   = last.*offset_field + last.*size_field;
+
+        MMapCache::MappingPtr mapping;
+        if(chunk_id < range.last_chunk && range_end - range_begin == run_size)
+            mapping = m_mmap_cache.get(m_fd_cache, path, range_end);
+
+        if(mapping) {
+            mapping->willNeed(range_begin, run_size);
+            pending.m_mappings.push_back(mapping);
+            pending.m_copies.push_back({
+                mapping->addr + range_begin, content_out + buf_offset, run_size});
+            buf_offset += run_size;
+        } else {
+            auto entry = m_fd_cache.get(path);
+            pending.m_entries.push_back(entry);
+            if(!entry || entry->fd < 0) {
+                pending.m_error = fmt::format("Failed to open {}", path);
+                break;
+            }
+            // Merge events that are adjacent in the file into a single
+            // pread of at most m_max_read_size bytes
+            for(size_t k = i; k < j;) {
+                uint64_t read_offset = records[k].*offset_field;
+                size_t   read_size   = 0;
+                do {
+                    read_size += records[k].*size_field;
+                    ++k;
+                } while(k < j
+                     && records[k].*offset_field == read_offset + read_size
+                     && read_size + records[k].*size_field <= m_max_read_size);
+                if(read_size > 0)
+                    pending.pread(entry->fd, content_out + buf_offset, read_size, read_offset);
+                buf_offset += read_size;
+            }
         }
-        buf_offset += rec.data_desc_size;
+        i = j;
     }
     return pending;
 }
 
-void DefaultPartitionManager::readDataFromDisk(
+void DefaultPartitionManager::PendingReads::pread(
+        int fd, char* dst, size_t size, uint64_t offset) {
+    m_rets.push_back(0);
+    m_sizes.push_back(size);
+    auto op = abt_io_pread_nb(m_abt_io, fd, dst, size, offset, &m_rets.back());
+    if(op) m_ops.push_back(op);
+    else m_rets.back() = -EIO;
+}
+
+Result<void> DefaultPartitionManager::PendingReads::wait() {
+    for(auto& c : m_copies) std::memcpy(c.dst, c.src, c.size);
+    for(auto* op : m_ops) { abt_io_op_wait(op); abt_io_op_free(op); }
+    for(size_t k = 0; k < m_rets.size() && m_error.empty(); ++k) {
+        if(m_rets[k] < 0)
+            m_error = fmt::format("Failed to read chunk file: {}", strerror(-m_rets[k]));
+        else if(static_cast<size_t>(m_rets[k]) != m_sizes[k])
+            m_error = fmt::format("Short read from chunk file ({} bytes out of {})",
+                                  m_rets[k], m_sizes[k]);
+    }
+    Result<void> result;
+    if(!m_error.empty()) {
+        result.success() = false;
+        result.error() = std::move(m_error);
+    }
+    m_ops.clear();
+    m_rets.clear();
+    m_sizes.clear();
+    m_entries.clear();
+    m_copies.clear();
+    m_mappings.clear();
+    m_error.clear();
+    return result;
+}
+
+DefaultPartitionManager::PendingReads DefaultPartitionManager::readMetadataFromDisk(
+        const IndexRange& range,
+        size_t* sizes_out, char* content_out) {
+    return readRecordsFromDisk(range, "meta",
+                               &IndexRecord::metadata_offset,
+                               &IndexRecord::metadata_size,
+                               sizes_out, content_out);
+}
+
+DefaultPartitionManager::PendingReads DefaultPartitionManager::readDescriptorsFromDisk(
+        const IndexRange& range,
+        size_t* sizes_out, char* content_out) {
+    return readRecordsFromDisk(range, "desc",
+                               &IndexRecord::data_desc_offset,
+                               &IndexRecord::data_desc_size,
+                               sizes_out, content_out);
+}
+
+size_t DefaultPartitionManager::readDataFromDisk(
         const std::vector<diaspora::DataDescriptor>& descriptors,
-        char* buffer, size_t total_size,
+        char* buffer,
         std::vector<Result<void>>& results) {
-    (void)total_size;
+    // Only the segments selected by each descriptor are read, packed
+    // back-to-back in the buffer in descriptor order. Events still in the
+    // write cache are copied from it; the others are read from disk with
+    // all the reads in flight together.
+    struct Read {
+        size_t   index;
+        int      fd;
+        char*    dst;
+        size_t   size;
+        uint64_t offset;
+    };
+    std::vector<Read> reads;
+    // Keeps the cached fds alive until all the reads have completed
+    std::unordered_map<uint32_t, FDCache::EntryPtr> entries;
+    size_t num_disk_reads = 0;
     size_t buffer_cursor = 0;
-    int current_fd = -1;
-    uint32_t current_chunk = UINT32_MAX;
     for(size_t i = 0; i < descriptors.size(); ++i) {
         auto& desc = descriptors[i];
         if(desc.size() == 0) continue;
         FileDataDescriptor fdd = FileDataDescriptor::fromDataDescriptor(desc);
-        if(fdd.chunk_id != current_chunk) {
-            if(current_fd >= 0) abt_io_close(m_abt_io, current_fd);
-            auto path = chunkPath(fdd.chunk_id, "data");
-            current_fd = abt_io_open(m_abt_io, path.c_str(), O_RDONLY, 0);
-            current_chunk = fdd.chunk_id;
+        auto segments = desc.flatten();
+        if(m_write_cache.enabled()) {
+            auto batch = m_write_cache.findData(fdd.chunk_id, fdd.offset, fdd.size);
+            if(batch) {
+                auto src = batch->data.data() + (fdd.offset - batch->data_offset);
+                for(auto& seg : segments) {
+                    std::memcpy(buffer + buffer_cursor, src + seg.offset, seg.size);
+                    buffer_cursor += seg.size;
+                }
+                continue;
+            }
         }
-        if(current_fd < 0) {
+        ++num_disk_reads;
+        auto it = entries.find(fdd.chunk_id);
+        if(it == entries.end())
+            it = entries.emplace(fdd.chunk_id, m_fd_cache.get(chunkPath(fdd.chunk_id, "data"))).first;
+        if(!it->second || it->second->fd < 0) {
             results[i].success() = false;
             results[i].error() = fmt::format("Failed to open chunk {}", fdd.chunk_id);
-            buffer_cursor += fdd.size;
+            buffer_cursor += desc.size();
             continue;
         }
-        abt_io_pread(m_abt_io, current_fd, buffer + buffer_cursor,
-                     fdd.size, fdd.offset);
-        buffer_cursor += fdd.size;
+        for(auto& seg : segments) {
+            reads.push_back({i, it->second->fd, buffer + buffer_cursor, seg.size, fdd.offset + seg.offset});
+            buffer_cursor += seg.size;
+        }
     }
-    if(current_fd >= 0) abt_io_close(m_abt_io, current_fd);
+
+    std::vector<abt_io_op_t*> ops(reads.size(), nullptr);
+    std::vector<ssize_t>      rets(reads.size(), 0);
+    for(size_t k = 0; k < reads.size(); ++k) {
+        auto& r = reads[k];
+        ops[k] = abt_io_pread_nb(m_abt_io, r.fd, r.dst, r.size, r.offset, &rets[k]);
+        if(!ops[k]) rets[k] = -EIO;
+    }
+    for(size_t k = 0; k < reads.size(); ++k) {
+        if(ops[k]) {
+            abt_io_op_wait(ops[k]);
+            abt_io_op_free(ops[k]);
+        }
+        auto& result = results[reads[k].index];
+        if(!result.success()) continue;
+        if(rets[k] < 0) {
+            result.success() = false;
+            result.error() = fmt::format("Failed to read data: {}", strerror(-rets[k]));
+        } else if(static_cast<size_t>(rets[k]) != reads[k].size) {
+            result.success() = false;
+            result.error() = fmt::format("Short read of data ({} bytes out of {})",
+                                         rets[k], reads[k].size);
+        }
+    }
+
+    return num_disk_reads;
 }
 
 void DefaultPartitionManager::PushOperation::startTransfers() {
@@ -381,31 +788,123 @@ void DefaultPartitionManager::PushOperation::startTransfers() {
     changeState(State::transfers_started);
 }
 
-void DefaultPartitionManager::PushOperation::waitTransfers() {
-    waitState(State::transfers_started);
-    if(m_metadata_async_op) m_metadata_async_op->wait();
-    if(m_data_async_op)     m_data_async_op->wait();
+void DefaultPartitionManager::PushOperation::completeTransfers() {
+    try {
+        if(m_metadata_async_op) m_metadata_async_op->wait();
+        if(m_data_async_op)     m_data_async_op->wait();
+        // compressed metadata is stored decompressed, so that the rest of
+        // the pipeline and the consumers never see the compressed block
+        if(m_transfer_error.empty() && m_metadata_codec != CompressionCodec::None) {
+            DecompressMetadata(m_metadata_codec, m_metadata_sizes,
+                               m_metadata_content.data(), m_metadata_content.size(),
+                               m_decompressed_metadata);
+            m_metadata_content = std::span<char>{m_decompressed_metadata};
+        }
+    } catch(const std::exception& ex) {
+        if(m_transfer_error.empty()) m_transfer_error = ex.what();
+    }
     changeState(State::transfers_completed);
 }
 
-void DefaultPartitionManager::receiveBatch(
+std::shared_ptr<DefaultPartitionManager::PushOperation>
+DefaultPartitionManager::submitPushOperation(
           const thallium::request& req,
           const std::string& producer_name,
           size_t num_events,
+          bool ack_early,
+          CompressionCodec metadata_codec,
           const BulkRef& metadata_bulk,
           const BulkRef& data_bulk)
 {
     auto op = std::make_shared<PushOperation>(
-        *this, req, producer_name, num_events, metadata_bulk, data_bulk);
-
+        *this, req, producer_name, num_events, ack_early, metadata_codec, metadata_bulk, data_bulk);
+    m_unstored_ops.fetch_add(1, std::memory_order_relaxed);
+    m_unstored_bytes.fetch_add(op->transferSize(), std::memory_order_relaxed);
+
+    try {
+        op->startTransfers();
+    } catch(const std::exception& ex) {
+        op->m_transfer_error = ex.what();
+    }
+    op->completeTransfers();
+
+    // Event IDs are only assigned to operations whose transfers succeeded,
+    // so that a failed operation neither fails the operations grouped with
+    // it nor leaves a hole in the IDs of the operations queued after it.
+    if(!op->m_transfer_error.empty()) {
+        m_unstored_ops.fetch_sub(1, std::memory_order_relaxed);
+        m_unstored_bytes.fetch_sub(op->transferSize(), std::memory_order_relaxed);
+        return op;
+    }
     {
         auto g = std::unique_lock<thallium::mutex>{m_write_queue_mtx};
         op->assignFirstID();
         m_write_queue.push_back(op);
         m_write_queue_cv.notify_one();
     }
+    return op;
+}
 
-    op->startTransfers();
+void DefaultPartitionManager::receiveBatch(
+          const thallium::request& req,
+          const std::string& producer_name,
+          size_t num_events,
+          CompressionCodec metadata_codec,
+          const BulkRef& metadata_bulk,
+          const BulkRef& data_bulk)
+{
+    auto op = submitPushOperation(req, producer_name, num_events, false, metadata_codec,
+                                  metadata_bulk, data_bulk);
+    // on success, the write loop responds once the batch is stored
+    if(op->m_transfer_error.empty()) return;
+    Result<diaspora::EventID> result;
+    result.success() = false;
+    result.error() = fmt::format("Failed to transfer batch: {}", op->m_transfer_error);
+    op->sendResponse(std::move(result));
+}
+
+void DefaultPartitionManager::receiveBatchAckEarly(
+          const thallium::request& req,
+          const std::string& producer_name,
+          size_t num_events,
+          CompressionCodec metadata_codec,
+          const BulkRef& metadata_bulk,
+          const BulkRef& data_bulk)
+{
+    // Backpressure: wait until the number of batches and bytes acknowledged
+    // but not yet stored is below the limits. A batch is always admitted
+    // when nothing is pending, whatever its size.
+    auto size = metadata_bulk.size + data_bulk.size;
+    {
+        auto g = std::unique_lock<thallium::mutex>{m_pending_mtx};
+        m_pending_cv.wait(g, [this, size]() {
+            if(m_pending_batches == 0) return true;
+            return m_pending_batches < m_ack_early_max_pending_batches
+                && m_pending_bytes + size <= m_ack_early_max_pending_bytes;
+        });
+        m_pending_batches += 1;
+        m_pending_bytes   += size;
+    }
+
+    auto op = submitPushOperation(req, producer_name, num_events, true, metadata_codec,
+                                  metadata_bulk, data_bulk);
+
+    // Respond as soon as the batch is in our memory; the write loop stores
+    // it and releases its pending slot in completeWrite. A batch that could
+    // not be transferred never reaches the write loop, so its slot is
+    // released here.
+    Result<diaspora::EventID> result;
+    if(op->m_transfer_error.empty()) {
+        result.value() = op->m_first_id;
+    } else {
+        result.success() = false;
+        result.error() = fmt::format("Failed to transfer batch: {}", op->m_transfer_error);
+        auto g = std::unique_lock<thallium::mutex>{m_pending_mtx};
+        m_pending_batches -= 1;
+        m_pending_bytes   -= size;
+        m_pending_cv.notify_all();
+    }
+    op->sendResponse(std::move(result));
 }
 
 void DefaultPartitionManager::wakeUp() {
@@ -430,6 +929,7 @@ Result<void> DefaultPartitionManager::feedConsumer(
 
     diaspora::Future<void>   prev_future;
     thallium::bulk_buffer<>  prev_meta_buf, prev_desc_buf;
+    IndexRange               range;
 
     while(!consumerHandle.shouldStop()) {
         size_t num_events = 0, total_meta = 0, total_desc = 0;
@@ -457,32 +957,60 @@ Result<void> DefaultPartitionManager::feedConsumer(
             return result;
         }
 
-        // CS 2: only m_index accesses need m_index_mtx; buffer alloc sits outside
+        // wait until the consumer has room for one more batch
+        if(!consumerHandle.acquireCredit()) break;
+
+        // CS 2: only m_index accesses need m_index_mtx; the records are
+        // copied out so that buffer allocation, file opens and mappings
+        // happen outside of it
         {
             auto g = std::unique_lock<thallium::mutex>{m_index_mtx};
-            for(size_t i = 0; i < num_events; ++i) {
-                total_meta += m_index[first_id + i].metadata_size;
-                total_desc += m_index[first_id + i].data_desc_size;
-            }
+            range.records.assign(m_index.begin() + first_id,
+                                 m_index.begin() + first_id + num_events);
+            range.chunk_ids.assign(m_event_chunk_ids.begin() + first_id,
+                                   m_event_chunk_ids.begin() + first_id + num_events);
+            range.last_chunk = m_event_chunk_ids.back();
+        }
+        for(auto& record : range.records) {
+            total_meta += record.metadata_size;
+            total_desc += record.data_desc_size;
         }
         auto sz = num_events * sizeof(size_t);
         meta_buf = m_consumer_metadata_buffer_pool.get(
             sz + std::max(total_meta, (size_t)1), /*extend=*/true);
         desc_buf = m_consumer_desc_buffer_pool.get(
             sz + std::max(total_desc, (size_t)1), /*extend=*/true);
-        {
-            auto g = std::unique_lock<thallium::mutex>{m_index_mtx};
-            meta_pending = readMetadataFromDisk(first_id, num_events,
+        auto cached = m_write_cache.enabled()
+                    ? m_write_cache.findRange(first_id, num_events)
+                    : std::vector<WriteCache::CachedBatchPtr>{};
+        if(!cached.empty()) {
+            ++m_write_cache.m_feed_hits;
+            readRecordsFromCache(cached, first_id, num_events,
+                reinterpret_cast<size_t*>(meta_buf.data()),
+                static_cast<char*>(meta_buf.data()) + sz,
+                reinterpret_cast<size_t*>(desc_buf.data()),
+                static_cast<char*>(desc_buf.data()) + sz);
+        } else {
+            if(m_write_cache.enabled()) ++m_write_cache.m_feed_misses;
+            meta_pending = readMetadataFromDisk(range,
                 reinterpret_cast<size_t*>(meta_buf.data()),
                 static_cast<char*>(meta_buf.data()) + sz);
-            desc_pending = readDescriptorsFromDisk(first_id, num_events,
+            desc_pending = readDescriptorsFromDisk(range,
                 reinterpret_cast<size_t*>(desc_buf.data()),
                 static_cast<char*>(desc_buf.data()) + sz);
         }
 
         // No mutex: wait disk reads, drain previous RDMA, start new RDMA
-        meta_pending.wait();
-        desc_pending.wait();
+        auto meta_read = meta_pending.wait();
+        auto desc_read = desc_pending.wait();
+        if(!meta_read.success() || !desc_read.success()) {
+            if(prev_future) prev_future.wait(-1);
+            result.success() = false;
+            result.error() = meta_read.success() ? desc_read.error() : meta_read.error();
+            spdlog::error("[mofka] Stopped feeding consumer {}: {}",
+                          consumerHandle.name(), result.error());
+            return result;
+        }
 
         if(prev_future) { prev_future.wait(-1); prev_future = {}; }
         prev_meta_buf = {};
@@ -491,9 +1019,9 @@ Result<void> DefaultPartitionManager::feedConsumer(
         prev_future = consumerHandle.feed(
             num_events, first_id,
             BulkRef{meta_buf.bulk(), 0,  sz,          self_addr},
-            BulkRef{meta_buf.bulk(), sz, total_meta,   self_addr},
+            BulkRef{meta_buf.bulk(), sz, total_meta,   self_addr, true},
             BulkRef{desc_buf.bulk(), 0,  sz,          self_addr},
-            BulkRef{desc_buf.bulk(), sz, total_desc,   self_addr});
+            BulkRef{desc_buf.bulk(), sz, total_desc,   self_addr, true});
         prev_meta_buf = std::move(meta_buf);
         prev_desc_buf = std::move(desc_buf);
         first_id     += num_events;
@@ -519,42 +1047,24 @@ Result<std::vector<Result<void>>> DefaultPartitionManager::getData(
     Result<std::vector<Result<void>>> result;
     result.value().resize(descriptors.size());
 
-    auto client_address = m_engine.lookup(bulk.address);
-
-    // Calculate total size from the file descriptors embedded in each DataDescriptor
+    // The selected segments of all the descriptors are packed back-to-back
     size_t total_data_size = 0;
-    for(auto& desc : descriptors) {
-        if(desc.size() == 0) continue;
-        total_data_size += FileDataDescriptor::fromDataDescriptor(desc).size;
-    }
+    for(auto& desc : descriptors) total_data_size += desc.size();
+    if(total_data_size == 0) return result;
 
-    // Read all data from disk into a flat buffer
-    std::vector<char> data_buffer(total_data_size);
-    readDataFromDisk(descriptors, data_buffer.data(), total_data_size, result.value());
+    auto client_address = m_engine.lookup(bulk.address);
 
-    // Build segments for the bulk transfer, respecting each descriptor's flatten() layout
-    std::vector<std::pair<void*, size_t>> local_segments;
-    size_t buffer_cursor = 0;
-    for(size_t i = 0; i < descriptors.size(); ++i) {
-        auto& desc = descriptors[i];
-        if(desc.size() == 0) continue;
-        FileDataDescriptor fdd = FileDataDescriptor::fromDataDescriptor(desc);
-        if(result.value()[i].success()) {
-            for(auto& seg : desc.flatten()) {
-                local_segments.push_back({
-                    data_buffer.data() + buffer_cursor + seg.offset,
-                    seg.size
-                });
-            }
-        }
-        buffer_cursor += fdd.size;
+    // Read into a pre-registered buffer so no memory gets exposed per call
+    auto data_buffer = m_consumer_data_buffer_pool.get(total_data_size, /*extend=*/true);
+    auto num_disk_reads = readDataFromDisk(
+        descriptors, static_cast<char*>(data_buffer.data()), result.value());
+    if(m_write_cache.enabled()) {
+        if(num_disk_reads == 0) ++m_write_cache.m_getdata_hits;
+        else ++m_write_cache.m_getdata_misses;
     }
 
-    if(!local_segments.empty()) {
-        auto local_data_bulk = m_engine.expose(
-            local_segments, thallium::bulk_mode::read_only);
-        bulk.handle.on(client_address) << local_data_bulk;
-    }
+    bulk.handle.on(client_address).select(bulk.offset, total_data_size)
+        << data_buffer.bulk()(0, total_data_size);
 
     return result;
 }
@@ -582,6 +1092,33 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
             "max_events_per_chunk": {"type": "integer"},
             "sync": {"type": "boolean"},
             "fd_cache_capacity": {"type": "integer", "minimum": 1},
+            "mmap_cache_max_bytes": {"type": "integer", "minimum": 0},
+            "max_read_size": {"type": "integer", "minimum": 1},
+            "write_pipeline_depth": {"type": "integer", "minimum": 1},
+            "ack_early": {
+                "type": "object",
+                "properties": {
+                    "enabled":             {"type": "boolean"},
+                    "max_pending_batches": {"type": "integer", "minimum": 1},
+                    "max_pending_bytes":   {"type": "integer", "minimum": 0}
+                }
+            },
+            "write_cache": {
+                "type": "object",
+                "properties": {
+                    "enabled":          {"type": "boolean"},
+                    "max_batches":      {"type": "integer", "minimum": 0},
+                    "max_memory_bytes": {"type": "integer", "minimum": 0}
+                }
+            },
+            "group_commit": {
+                "type": "object",
+                "properties": {
+                    "enabled":       {"type": "boolean"},
+                    "max_batches":   {"type": "integer", "minimum": 1},
+                    "max_linger_us": {"type": "integer", "minimum": 0}
+                }
+            },
             "producers": {
                 "type": "object",
                 "properties": {
@@ -625,6 +1162,15 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
                             "first_size":    {"type": "integer", "minimum": 1},
                             "size_multiple": {"type": "number",  "exclusiveMinimum": 1.0}
                         }
+                    },
+                    "data_buffer_pool": {
+                        "type": "object",
+                        "properties": {
+                            "num_tiers":     {"type": "integer", "minimum": 1},
+                            "num_buffers":   {"type": "integer", "minimum": 0},
+                            "first_size":    {"type": "integer", "minimum": 1},
+                            "size_multiple": {"type": "number",  "exclusiveMinimum": 1.0}
+                        }
                     }
                 }
             }
@@ -654,6 +1200,19 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
     size_t max_events_per_chunk  = json.value("max_events_per_chunk", (size_t)1000000);
     bool sync                    = json.value("sync", true);
     size_t fd_cache_capacity     = json.value("fd_cache_capacity", (size_t)64);
+    size_t mmap_cache_max_bytes  = json.value("mmap_cache_max_bytes", (size_t)(1024*1024*1024));
+    size_t max_read_size         = json.value("max_read_size", (size_t)(4*1024*1024));
+
+    size_t write_pipeline_depth       = json.value("write_pipeline_depth", (size_t)2);
+    bool   ack_early                  = json.value("/ack_early/enabled"_json_pointer,             false);
+    size_t ack_early_max_batches      = json.value("/ack_early/max_pending_batches"_json_pointer, (size_t)8);
+    size_t ack_early_max_bytes        = json.value("/ack_early/max_pending_bytes"_json_pointer,   (size_t)(256*1024*1024));
+    bool   write_cache                = json.value("/write_cache/enabled"_json_pointer,          true);
+    size_t write_cache_max_batches    = json.value("/write_cache/max_batches"_json_pointer,      (size_t)16);
+    size_t write_cache_max_memory     = json.value("/write_cache/max_memory_bytes"_json_pointer, (size_t)(64*1024*1024));
+    bool   group_commit               = json.value("/group_commit/enabled"_json_pointer,       false);
+    size_t group_commit_max_batches   = json.value("/group_commit/max_batches"_json_pointer,   (size_t)64);
+    size_t group_commit_max_linger_us = json.value("/group_commit/max_linger_us"_json_pointer, (size_t)0);
 
     size_t meta_num_tiers     = json.value("/producers/metadata_buffer_pool/num_tiers"_json_pointer,     (size_t)1);
     size_t meta_num_buffers   = json.value("/producers/metadata_buffer_pool/num_buffers"_json_pointer,   (size_t)0);
@@ -675,6 +1234,11 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
     size_t cdesc_first_size    = json.value("/consumers/desc_buffer_pool/first_size"_json_pointer,        (size_t)(4*1024));
     float  cdesc_size_multiple = json.value("/consumers/desc_buffer_pool/size_multiple"_json_pointer,     4.0f);
 
+    size_t cdata_num_tiers     = json.value("/consumers/data_buffer_pool/num_tiers"_json_pointer,         (size_t)1);
+    size_t cdata_num_buffers   = json.value("/consumers/data_buffer_pool/num_buffers"_json_pointer,       (size_t)0);
+    size_t cdata_first_size    = json.value("/consumers/data_buffer_pool/first_size"_json_pointer,        (size_t)(1024*1024));
+    float  cdata_size_multiple = json.value("/consumers/data_buffer_pool/size_multiple"_json_pointer,     4.0f);
+
     /* Create directory: <path>/<topic_name>-<uuid>/ */
     std::string partition_path = base_path + "/" + topic_name + "-" + partition_uuid.to_string();
     mkdirs(partition_path);
@@ -758,7 +1322,23 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
             .consumer_desc_pool_num_buffers       = cdesc_num_buffers,
             .consumer_desc_pool_first_size        = cdesc_first_size,
             .consumer_desc_pool_size_multiple     = cdesc_size_multiple,
+            .consumer_data_pool_num_tiers         = cdata_num_tiers,
+            .consumer_data_pool_num_buffers       = cdata_num_buffers,
+            .consumer_data_pool_first_size        = cdata_first_size,
+            .consumer_data_pool_size_multiple     = cdata_size_multiple,
             .fd_cache_capacity                    = fd_cache_capacity,
+            .mmap_cache_max_bytes                 = mmap_cache_max_bytes,
+            .max_read_size                        = max_read_size,
+            .group_commit                         = group_commit,
+            .group_commit_max_batches             = group_commit_max_batches,
+            .group_commit_max_linger_us           = group_commit_max_linger_us,
+            .write_pipeline_depth                 = write_pipeline_depth,
+            .write_cache                          = write_cache,
+            .write_cache_max_batches              = write_cache_max_batches,
+            .write_cache_max_memory_bytes         = write_cache_max_memory,
+            .ack_early                            = ack_early,
+            .ack_early_max_pending_batches        = ack_early_max_batches,
+            .ack_early_max_pending_bytes          = ack_early_max_bytes,
         }));
 
     /* Build the effective configuration (with defaults filled in) */
@@ -768,6 +1348,21 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
         {"max_events_per_chunk", max_events_per_chunk},
         {"sync", sync},
         {"fd_cache_capacity", fd_cache_capacity},
+        {"mmap_cache_max_bytes", mmap_cache_max_bytes},
+        {"max_read_size", max_read_size},
+        {"write_pipeline_depth", write_pipeline_depth},
+        {"ack_early", {
+            {"enabled", ack_early},
+            {"max_pending_batches", ack_early_max_batches},
+            {"max_pending_bytes", ack_early_max_bytes}}},
+        {"write_cache", {
+            {"enabled", write_cache},
+            {"max_batches", write_cache_max_batches},
+            {"max_memory_bytes", write_cache_max_memory}}},
+        {"group_commit", {
+            {"enabled", group_commit},
+            {"max_batches", group_commit_max_batches},
+            {"max_linger_us", group_commit_max_linger_us}}},
         {"producers", {
             {"metadata_buffer_pool", {
                 {"num_tiers", meta_num_tiers},
@@ -789,7 +1384,12 @@ std::unique_ptr<mofka::PartitionManager> DefaultPartitionManager::create(
                 {"num_tiers", cdesc_num_tiers},
                 {"num_buffers", cdesc_num_buffers},
                 {"first_size", cdesc_first_size},
-                {"size_multiple", cdesc_size_multiple}}}}}
+                {"size_multiple", cdesc_size_multiple}}},
+            {"data_buffer_pool", {
+                {"num_tiers", cdata_num_tiers},
+                {"num_buffers", cdata_num_buffers},
+                {"first_size", cdata_first_size},
+                {"size_multiple", cdata_size_multiple}}}}}
     };
     manager->m_config = diaspora::Metadata{std::move(effective_config)};
 
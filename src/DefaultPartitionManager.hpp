@@ -12,7 +12,12 @@
 #include <thallium/bulk_buffer_pool.hpp>
 #include <abt-io.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cstdint>
+#include <cstring>
+#include <chrono>
 #include <optional>
 #include <span>
 #include <string>
@@ -20,6 +25,7 @@
 #include <list>
 #include <memory>
 #include <algorithm>
+#include <atomic>
 #include <unordered_map>
 
 namespace mofka {
@@ -51,7 +57,28 @@ struct DefaultPartitionManagerOptions {
     size_t             consumer_desc_pool_first_size       = 4 * 1024;
     float              consumer_desc_pool_size_multiple    = 4.0f;
 
+    size_t             consumer_data_pool_num_tiers        = 1;
+    size_t             consumer_data_pool_num_buffers      = 0;
+    size_t             consumer_data_pool_first_size       = 1024 * 1024;
+    float              consumer_data_pool_size_multiple    = 4.0f;
+
     size_t             fd_cache_capacity                   = 64;
+    size_t             mmap_cache_max_bytes                = 1024 * 1024 * 1024;
+    size_t             max_read_size                       = 4 * 1024 * 1024;
+
+    bool               group_commit                        = false;
+    size_t             group_commit_max_batches            = 64;
+    size_t             group_commit_max_linger_us          = 0;
+
+    size_t             write_pipeline_depth                = 2;
+
+    bool               write_cache                         = true;
+    size_t             write_cache_max_batches             = 16;
+    size_t             write_cache_max_memory_bytes        = 64 * 1024 * 1024;
+
+    bool               ack_early                           = false;
+    size_t             ack_early_max_pending_batches       = 8;
+    size_t             ack_early_max_pending_bytes         = 256 * 1024 * 1024;
 };
 
 /**
@@ -162,6 +189,199 @@ class DefaultPartitionManager : public mofka::PartitionManager {
         }
     };
 
+    // LRU cache of read-only memory mappings of sealed chunk files, keyed by
+    // path and bounded by the total number of bytes mapped.
+    struct MMapCache {
+        // Each mapping is reference-counted via shared_ptr. The range is
+        // unmapped only when both the cache and all outstanding readers
+        // release it.
+        struct Mapping {
+            std::string path;
+            char*       addr   = nullptr;
+            size_t      length = 0;
+            Mapping(std::string p, char* a, size_t l) noexcept
+            : path(std::move(p)), addr(a), length(l) {}
+            Mapping(const Mapping&) = delete;
+            Mapping& operator=(const Mapping&) = delete;
+            Mapping(Mapping&&) = delete;
+            Mapping& operator=(Mapping&&) = delete;
+            ~Mapping() noexcept { if(addr) ::munmap(addr, length); }
+
+            // Starts reading the pages of [offset, offset+size) in the
+            // background, so that copying them later does not fault on
+            // the calling execution stream
+            void willNeed(size_t offset, size_t size) const noexcept {
+                static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+                size_t begin = offset - offset % page_size;
+                ::madvise(addr + begin, std::min(offset + size, length) - begin, MADV_WILLNEED);
+            }
+        };
+        using MappingPtr = std::shared_ptr<Mapping>;
+
+        size_t                                                            m_max_bytes = 0;
+        size_t                                                            m_mapped_bytes = 0;
+        std::list<MappingPtr>                                             m_lru;
+        std::unordered_map<std::string, std::list<MappingPtr>::iterator>  m_map;
+        thallium::mutex                                                   m_mtx;
+
+        MMapCache() = default;
+        explicit MMapCache(size_t max_bytes)
+        : m_max_bytes(max_bytes) {}
+
+        MMapCache(const MMapCache&) = delete;
+        MMapCache& operator=(const MMapCache&) = delete;
+        MMapCache(MMapCache&&) = delete;
+        MMapCache& operator=(MMapCache&&) = delete;
+
+        ~MMapCache() noexcept { clear(); }
+
+        // Returns a mapping of the whole file covering at least min_length
+        // bytes, or nullptr if the file can't be mapped within the budget
+        // (the caller should then fall back to regular reads). The file
+        // must no longer be written to.
+        MappingPtr get(FDCache& fd_cache, const std::string& path, size_t min_length) {
+            auto g = std::unique_lock<thallium::mutex>{m_mtx};
+            auto it = m_map.find(path);
+            if(it != m_map.end()) {
+                if((*it->second)->length >= min_length) {
+                    m_lru.splice(m_lru.begin(), m_lru, it->second);
+                    return *it->second;
+                }
+                // Mapped before the file reached its final size
+                m_mapped_bytes -= (*it->second)->length;
+                m_lru.erase(it->second);
+                m_map.erase(it);
+            }
+            if(min_length == 0 || min_length > m_max_bytes) return {};
+            auto entry = fd_cache.get(path);
+            if(!entry || entry->fd < 0) return {};
+            struct stat st;
+            if(::fstat(entry->fd, &st) != 0) return {};
+            size_t length = static_cast<size_t>(st.st_size);
+            if(length < min_length || length > m_max_bytes) return {};
+            void* addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, entry->fd, 0);
+            if(addr == MAP_FAILED) return {};
+            while(m_mapped_bytes + length > m_max_bytes) {
+                bool evicted = false;
+                for(auto eit = m_lru.rbegin(); eit != m_lru.rend(); ++eit) {
+                    if((*eit).use_count() == 1) {
+                        m_mapped_bytes -= (*eit)->length;
+                        m_map.erase((*eit)->path);
+                        m_lru.erase(std::next(eit).base());
+                        evicted = true;
+                        break;
+                    }
+                }
+                if(!evicted) break;  // all mappings in-use; allow temporary growth
+            }
+            auto mapping = std::make_shared<Mapping>(path, static_cast<char*>(addr), length);
+            m_lru.push_front(mapping);
+            m_map[path] = m_lru.begin();
+            m_mapped_bytes += length;
+            return mapping;
+        }
+
+        void clear() noexcept {
+            auto g = std::unique_lock<thallium::mutex>{m_mtx};
+            m_lru.clear();
+            m_map.clear();
+            m_mapped_bytes = 0;
+        }
+    };
+
+    // In-memory copy of the most recently stored batches, so that consumers
+    // following the write frontier are served without any disk I/O.
+    // Batches are inserted in event-ID order and evicted FIFO.
+    struct WriteCache {
+        struct CachedBatch {
+            diaspora::EventID        first_id = 0;
+            uint32_t                 chunk_id = 0;
+            std::vector<IndexRecord> records;
+            // Content of the batch in each file, and the file offset of its first byte
+            std::vector<char>        metadata;
+            std::vector<char>        data;
+            std::vector<char>        descriptors;
+            uint64_t                 metadata_offset = 0;
+            uint64_t                 data_offset     = 0;
+            uint64_t                 desc_offset     = 0;
+
+            size_t numEvents() const { return records.size(); }
+            size_t memory() const {
+                return metadata.size() + data.size() + descriptors.size()
+                     + records.size() * sizeof(IndexRecord);
+            }
+        };
+        using CachedBatchPtr = std::shared_ptr<const CachedBatch>;
+
+        bool                        m_enabled = false;
+        size_t                      m_max_batches = 0;
+        size_t                      m_max_memory_bytes = 0;
+        size_t                      m_memory_bytes = 0;
+        std::deque<CachedBatchPtr>  m_batches;
+        thallium::mutex             m_mtx;
+
+        std::atomic<size_t>         m_feed_hits      = 0;
+        std::atomic<size_t>         m_feed_misses    = 0;
+        std::atomic<size_t>         m_getdata_hits   = 0;
+        std::atomic<size_t>         m_getdata_misses = 0;
+
+        WriteCache() = default;
+        WriteCache(bool enabled, size_t max_batches, size_t max_memory_bytes)
+        : m_enabled(enabled && max_batches > 0)
+        , m_max_batches(max_batches)
+        , m_max_memory_bytes(max_memory_bytes) {}
+
+        WriteCache(const WriteCache&) = delete;
+        WriteCache& operator=(const WriteCache&) = delete;
+        WriteCache(WriteCache&&) = delete;
+        WriteCache& operator=(WriteCache&&) = delete;
+
+        bool enabled() const { return m_enabled; }
+
+        void insert(CachedBatchPtr batch) {
+            auto g = std::unique_lock<thallium::mutex>{m_mtx};
+            m_memory_bytes += batch->memory();
+            m_batches.push_back(std::move(batch));
+            while(!m_batches.empty()
+               && (m_batches.size() > m_max_batches || m_memory_bytes > m_max_memory_bytes)) {
+                m_memory_bytes -= m_batches.front()->memory();
+                m_batches.pop_front();
+            }
+        }
+
+        // Returns the batches covering [first_id, first_id+count) in order,
+        // or an empty vector if any event in that range isn't cached.
+        std::vector<CachedBatchPtr> findRange(diaspora::EventID first_id, size_t count) {
+            std::vector<CachedBatchPtr> result;
+            auto g = std::unique_lock<thallium::mutex>{m_mtx};
+            auto expected = first_id;
+            auto end      = first_id + count;
+            for(auto& batch : m_batches) {
+                if(expected >= end) break;
+                auto batch_end = batch->first_id + batch->numEvents();
+                if(batch_end <= expected) continue;
+                if(batch->first_id > expected) break;
+                result.push_back(batch);
+                expected = batch_end;
+            }
+            if(expected < end) result.clear();
+            return result;
+        }
+
+        // Returns the batch holding the data at the given chunk location, if any.
+        CachedBatchPtr findData(uint32_t chunk_id, uint64_t offset, size_t size) {
+            auto g = std::unique_lock<thallium::mutex>{m_mtx};
+            for(auto it = m_batches.rbegin(); it != m_batches.rend(); ++it) {
+                auto& batch = *it;
+                if(batch->chunk_id != chunk_id) continue;
+                if(offset >= batch->data_offset
+                && offset + size <= batch->data_offset + batch->data.size())
+                    return batch;
+            }
+            return {};
+        }
+    };
+
     // Resolved configuration (with defaults filled in), published via getConfig()
     diaspora::Metadata  m_config;
 
@@ -171,12 +391,31 @@ class DefaultPartitionManager : public mofka::PartitionManager {
     size_t              m_max_events_per_chunk;
     bool                m_sync;
 
+    // Group commit: the write loop drains up to m_group_commit_max_batches
+    // queued operations (waiting at most m_group_commit_max_linger for more
+    // to arrive) and writes them with a single fdatasync round.
+    bool                      m_group_commit;
+    size_t                    m_group_commit_max_batches;
+    std::chrono::microseconds m_group_commit_max_linger;
+
+    // Maximum number of writes whose I/O may be in flight at once
+    size_t                    m_write_pipeline_depth;
+
     // ABT-IO
     abt_io_instance_id  m_abt_io;
 
     // File descriptor cache
     FDCache             m_fd_cache;
 
+    // Memory mappings of sealed chunks
+    MMapCache           m_mmap_cache;
+
+    // Upper bound on the size of a coalesced pread on the feed path
+    size_t              m_max_read_size;
+
+    // Recently stored batches
+    WriteCache          m_write_cache;
+
     // Engine
     thallium::engine    m_engine;
 
@@ -187,13 +426,39 @@ class DefaultPartitionManager : public mofka::PartitionManager {
     // Buffer pools for outgoing consumer RDMA transfers (read_only)
     thallium::bulk_buffer_pool<> m_consumer_metadata_buffer_pool;
     thallium::bulk_buffer_pool<> m_consumer_desc_buffer_pool;
+    thallium::bulk_buffer_pool<> m_consumer_data_buffer_pool;
+
+    // Read-write file descriptors of a chunk. Shared between the write
+    // cursor and the in-flight writes targeting that chunk, so rotating to
+    // a new chunk never closes files that still have I/O pending.
+    struct ChunkFiles {
+        uint32_t id;
+        int      fd_meta = -1;
+        int      fd_data = -1;
+        int      fd_desc = -1;
+        int      fd_idx  = -1;
+
+        explicit ChunkFiles(uint32_t chunk_id) noexcept : id(chunk_id) {}
+        ChunkFiles(const ChunkFiles&) = delete;
+        ChunkFiles& operator=(const ChunkFiles&) = delete;
+        ChunkFiles(ChunkFiles&&) = delete;
+        ChunkFiles& operator=(ChunkFiles&&) = delete;
+
+        // Use POSIX close() instead of abt_io_close() because this may run
+        // during destructor teardown when ABT pools are already destroyed.
+        // All data has been flushed via abt_io_fdatasync() during normal operation.
+        ~ChunkFiles() noexcept {
+            if(fd_meta >= 0) ::close(fd_meta);
+            if(fd_data >= 0) ::close(fd_data);
+            if(fd_desc >= 0) ::close(fd_desc);
+            if(fd_idx  >= 0) ::close(fd_idx);
+        }
+    };
 
-    // Current chunk write state
-    uint32_t            m_current_chunk_id = 0;
-    int                 m_fd_meta = -1;
-    int                 m_fd_data = -1;
-    int                 m_fd_desc = -1;
-    int                 m_fd_idx  = -1;
+    // Current chunk write state. The offsets are those of the next write to
+    // be issued, which may be ahead of what has been published to m_index.
+    uint32_t                    m_current_chunk_id = 0;
+    std::shared_ptr<ChunkFiles> m_chunk;
     uint64_t            m_meta_offset = 0;
     uint64_t            m_data_offset = 0;
     uint64_t            m_desc_offset = 0;
@@ -210,6 +475,17 @@ class DefaultPartitionManager : public mofka::PartitionManager {
     thallium::mutex              m_events_mtx;
     thallium::condition_variable m_events_cv;
 
+    // Early acknowledgment: batches acknowledged before being stored are
+    // counted until their write completes, and new ones wait while either
+    // limit is reached.
+    bool                         m_ack_early;
+    size_t                       m_ack_early_max_pending_batches;
+    size_t                       m_ack_early_max_pending_bytes;
+    size_t                       m_pending_batches = 0;
+    size_t                       m_pending_bytes   = 0;
+    thallium::mutex              m_pending_mtx;
+    thallium::condition_variable m_pending_cv;
+
     // Consumer cursors
     std::unordered_map<std::string, diaspora::EventID> m_consumer_cursor;
     thallium::mutex                                    m_consumer_cursor_mtx;
@@ -219,9 +495,9 @@ class DefaultPartitionManager : public mofka::PartitionManager {
 
         enum class State : uint8_t {
             submitted,
-            assigned,
             transfers_started,
             transfers_completed,
+            assigned,
             stored
         };
 
@@ -229,17 +505,21 @@ class DefaultPartitionManager : public mofka::PartitionManager {
         thallium::request            m_req;
         std::string                  m_producer_name;
         size_t                       m_num_events;
+        bool                         m_ack_early;
+        CompressionCodec             m_metadata_codec;
         BulkRef                      m_remote_metadata_bulk;
         BulkRef                      m_remote_data_bulk;
         // Buffers populated by startTransfers
         thallium::bulk_buffer<>                      m_metadata_buffer;
         std::span<size_t>                            m_metadata_sizes;
         std::span<char>                              m_metadata_content;
+        std::vector<char>                            m_decompressed_metadata;
         thallium::bulk_buffer<>                      m_data_buffer;
         std::span<size_t>                            m_data_sizes;
         std::span<char>                              m_data_content;
         std::optional<thallium::async_bulk_op>       m_metadata_async_op;
         std::optional<thallium::async_bulk_op>       m_data_async_op;
+        std::string                  m_transfer_error;
         diaspora::EventID            m_first_id = 0;
         State                        m_state = State::submitted;
         bool                         m_responded = false;
@@ -250,16 +530,21 @@ class DefaultPartitionManager : public mofka::PartitionManager {
                       const thallium::request& req,
                       const std::string& producer_name,
                       size_t num_events,
+                      bool ack_early,
+                      CompressionCodec metadata_codec,
                       const BulkRef& metadata_bulk,
                       const BulkRef& data_bulk)
         : m_manager(manager)
         , m_req(req)
         , m_producer_name(producer_name)
         , m_num_events(num_events)
+        , m_ack_early(ack_early)
+        , m_metadata_codec(metadata_codec)
         , m_remote_metadata_bulk(metadata_bulk)
         , m_remote_data_bulk(data_bulk)
         {}
 
+        size_t transferSize()        const { return m_remote_metadata_bulk.size + m_remote_data_bulk.size; }
         size_t metadataContentSize() const { return m_remote_metadata_bulk.size - m_num_events * sizeof(size_t); }
         size_t dataContentSize()     const { return m_remote_data_bulk.size     - m_num_events * sizeof(size_t); }
 
@@ -270,15 +555,15 @@ class DefaultPartitionManager : public mofka::PartitionManager {
             m_state_cv.notify_all();
         }
 
+        // May be called both by the handler ULT (early acknowledgment)
+        // and by the write loop; only the first call responds.
         void sendResponse(Result<diaspora::EventID> result) {
-            if(m_responded) return;
-            m_responded = true;
-            m_req.respond(result);
-        }
-
-        void waitState(State expected) {
-            auto g = std::unique_lock<thallium::mutex>{m_state_mtx};
-            m_state_cv.wait(g, [this, expected]() { return m_state >= expected; });
+            {
+                auto g = std::unique_lock<thallium::mutex>{m_state_mtx};
+                if(m_responded) return;
+                m_responded = true;
+            }
+            m_req.respond(result, m_manager.load());
         }
 
         void assignFirstID() {
@@ -288,10 +573,40 @@ class DefaultPartitionManager : public mofka::PartitionManager {
         }
 
         void startTransfers();
-        void waitTransfers();
-        void writeToFiles();
+        void completeTransfers();
     };
 
+    using PushOperationGroup = std::vector<std::shared_ptr<PushOperation>>;
+
+    // A run of operations stored contiguously in the same chunk, from the
+    // moment its offsets are assigned until its writes complete.
+    struct PendingWrite {
+        std::shared_ptr<ChunkFiles>  m_chunk;
+        PushOperationGroup           m_ops;
+        std::vector<IndexRecord>     m_records;
+        std::vector<char>            m_desc_buf;
+        uint64_t                     m_meta_offset = 0;
+        uint64_t                     m_data_offset = 0;
+        uint64_t                     m_desc_offset = 0;
+        uint64_t                     m_idx_offset  = 0;
+        std::vector<abt_io_op_t*>    m_io_ops;
+        std::vector<ssize_t>         m_io_rets;   // stable pointers after reserve()
+        std::vector<size_t>          m_io_owners; // index in m_ops of each m_io_rets entry
+        std::vector<std::string>     m_op_errors; // errors affecting a single operation
+        std::string                  m_error;     // error affecting the whole run
+
+        size_t numEvents() const { return m_records.size(); }
+
+        const std::string& error(size_t i) const {
+            return m_error.empty() ? m_op_errors[i] : m_error;
+        }
+    };
+
+    // Number of operations submitted but not yet stored, and the
+    // number of bytes they transfer, reported by load()
+    std::atomic<uint64_t>                      m_unstored_ops   = 0;
+    std::atomic<uint64_t>                      m_unstored_bytes = 0;
+
     // Write queue
     std::deque<std::shared_ptr<PushOperation>> m_write_queue;
     thallium::mutex                            m_write_queue_mtx;
@@ -300,13 +615,39 @@ class DefaultPartitionManager : public mofka::PartitionManager {
     thallium::managed<thallium::thread>        m_write_ult;
 
     void writeLoop();
+    void collectGroup(PushOperationGroup& group);
+    void prepareWrites(const PushOperationGroup& group,
+                       std::deque<std::unique_ptr<PendingWrite>>& writes);
+    std::unique_ptr<PendingWrite> prepareWrite(
+            const PushOperationGroup& group, size_t begin, size_t end);
+    void issueWrite(PendingWrite& write);
+    void completeWrite(PendingWrite& write);
+    std::shared_ptr<PushOperation> submitPushOperation(
+            const thallium::request& req,
+            const std::string& producer_name,
+            size_t num_events,
+            bool ack_early,
+            CompressionCodec metadata_codec,
+            const BulkRef& metadata_bulk,
+            const BulkRef& data_bulk);
 
-    // RAII handle for a batch of in-flight abt_io_pread_nb operations.
+    // RAII handle for a batch of in-flight abt_io_pread_nb operations,
+    // and of copies out of mapped chunks deferred until wait().
     struct PendingReads {
-        abt_io_instance_id              m_abt_io = ABT_IO_INSTANCE_NULL;
-        std::vector<abt_io_op_t*>       m_ops;
-        std::vector<ssize_t>            m_rets;     // stable pointers after reserve()
-        std::vector<FDCache::EntryPtr>  m_entries;  // keeps fds alive until wait()
+        struct Copy {
+            const char* src;
+            char*       dst;
+            size_t      size;
+        };
+
+        abt_io_instance_id                  m_abt_io = ABT_IO_INSTANCE_NULL;
+        std::vector<abt_io_op_t*>           m_ops;
+        std::vector<ssize_t>                m_rets;     // stable pointers after reserve()
+        std::vector<size_t>                 m_sizes;    // expected result of each m_rets entry
+        std::vector<FDCache::EntryPtr>      m_entries;  // keeps fds alive until wait()
+        std::vector<Copy>                   m_copies;
+        std::vector<MMapCache::MappingPtr>  m_mappings; // keeps mappings alive until wait()
+        std::string                         m_error;    // first read that could not be issued
 
         PendingReads() = default;
         explicit PendingReads(abt_io_instance_id ai) : m_abt_io(ai) {}
@@ -316,12 +657,12 @@ class DefaultPartitionManager : public mofka::PartitionManager {
         PendingReads& operator=(const PendingReads&) = delete;
         ~PendingReads() noexcept { wait(); }
 
-        void wait() {
-            for(auto* op : m_ops) { abt_io_op_wait(op); abt_io_op_free(op); }
-            m_ops.clear();
-            m_rets.clear();
-            m_entries.clear();
-        }
+        // Issues a pread of size bytes, recording an error if it can't be
+        void pread(int fd, char* dst, size_t size, uint64_t offset);
+
+        // Completes the reads, returning an error if any of them failed
+        // or read fewer bytes than requested
+        Result<void> wait();
     };
 
     // Helpers
@@ -331,13 +672,31 @@ class DefaultPartitionManager : public mofka::PartitionManager {
     void rotateChunk();
     bool shouldRotate() const;
 
-    PendingReads readMetadataFromDisk(diaspora::EventID first_id, size_t count,
+    // Index records of a range of events and the chunks that hold them,
+    // copied out of m_index so that reading them needs no lock
+    struct IndexRange {
+        std::vector<IndexRecord> records;
+        std::vector<uint32_t>    chunk_ids;
+        uint32_t                 last_chunk = 0; // chunk of the last published event
+    };
+
+    PendingReads readRecordsFromDisk(const IndexRange& range,
+                                      const char* ext,
+                                      uint64_t IndexRecord::* offset_field,
+                                      uint32_t IndexRecord::* size_field,
+                                      size_t* sizes_out, char* content_out);
+    PendingReads readMetadataFromDisk(const IndexRange& range,
                                        size_t* sizes_out, char* content_out);
-    PendingReads readDescriptorsFromDisk(diaspora::EventID first_id, size_t count,
+    PendingReads readDescriptorsFromDisk(const IndexRange& range,
                                           size_t* sizes_out, char* content_out);
-    void readDataFromDisk(const std::vector<diaspora::DataDescriptor>& descriptors,
-                          char* buffer, size_t total_size,
-                          std::vector<Result<void>>& results);
+    void readRecordsFromCache(const std::vector<WriteCache::CachedBatchPtr>& batches,
+                              diaspora::EventID first_id, size_t count,
+                              size_t* meta_sizes_out, char* meta_content_out,
+                              size_t* desc_sizes_out, char* desc_content_out);
+    void cacheWrite(const PendingWrite& write);
+    size_t readDataFromDisk(const std::vector<diaspora::DataDescriptor>& descriptors,
+                            char* buffer,
+                            std::vector<Result<void>>& results);
 
     public:
 
@@ -355,11 +714,28 @@ class DefaultPartitionManager : public mofka::PartitionManager {
             const thallium::request& req,
             const std::string& producer_name,
             size_t num_events,
+            CompressionCodec metadata_codec,
+            const BulkRef& metadata_bulk,
+            const BulkRef& data_bulk) override;
+
+    bool supportsAckEarly() const override { return m_ack_early; }
+
+    void receiveBatchAckEarly(
+            const thallium::request& req,
+            const std::string& producer_name,
+            size_t num_events,
+            CompressionCodec metadata_codec,
             const BulkRef& metadata_bulk,
             const BulkRef& data_bulk) override;
 
     void wakeUp() override;
 
+    PartitionLoad load() const override {
+        return PartitionLoad{
+            m_unstored_ops.load(std::memory_order_relaxed),
+            m_unstored_bytes.load(std::memory_order_relaxed)};
+    }
+
     Result<void> feedConsumer(
             ConsumerHandle consumerHandle,
             diaspora::BatchSize batchSize) override;
@@ -376,6 +752,21 @@ class DefaultPartitionManager : public mofka::PartitionManager {
 
     diaspora::Metadata getConfig() const override { return m_config; }
 
+    struct WriteCacheStats {
+        size_t feed_hits;
+        size_t feed_misses;
+        size_t getdata_hits;
+        size_t getdata_misses;
+    };
+
+    WriteCacheStats writeCacheStats() const {
+        return WriteCacheStats{
+            m_write_cache.m_feed_hits.load(),
+            m_write_cache.m_feed_misses.load(),
+            m_write_cache.m_getdata_hits.load(),
+            m_write_cache.m_getdata_misses.load()};
+    }
+
     static std::unique_ptr<mofka::PartitionManager> create(
         const thallium::engine& engine,
         const std::string& topic_name,
@@ -0,0 +1,110 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_KEY_HASH_PARTITION_SELECTOR_H
+#define MOFKA_KEY_HASH_PARTITION_SELECTOR_H
+
+#include <diaspora/Metadata.hpp>
+#include <diaspora/PartitionSelector.hpp>
+#include <diaspora/Exception.hpp>
+
+#include <atomic>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief PartitionSelector that hashes a field of the event's metadata,
+ * so that all the events with the same key go to the same partition.
+ * Its configuration is of the form:
+ *
+ * {
+ *     "type": "key_hash",
+ *     "key": "<field name or JSON pointer such as /a/b>"
+ * }
+ *
+ * Events whose metadata does not contain the key are distributed
+ * round-robin. The hash (FNV-1a over the key's string value, or over its
+ * JSON representation for non-string values) does not depend on the
+ * platform, so that producers in different processes agree on the
+ * partition of a key. selectPartitionFor is lock-free.
+ */
+class KeyHashPartitionSelector : public diaspora::PartitionSelectorInterface {
+
+    public:
+
+    explicit KeyHashPartitionSelector(std::string key)
+    : m_key{std::move(key)} {
+        if(!m_key.empty() && m_key[0] == '/')
+            m_pointer = nlohmann::json::json_pointer{m_key};
+    }
+
+    void setPartitions(const std::vector<diaspora::PartitionInfo>& targets) override {
+        m_targets = targets;
+    }
+
+    size_t selectPartitionFor(const diaspora::Metadata& metadata,
+                              std::optional<size_t> requested) override {
+        if(m_targets.size() == 0)
+            throw diaspora::Exception("PartitionSelector has no target to select from");
+        if(requested.has_value())
+            return requested.value() % m_targets.size();
+        const auto& json = metadata.json();
+        const nlohmann::json* value = nullptr;
+        if(json.is_object()) {
+            if(m_pointer.has_value()) {
+                if(json.contains(*m_pointer)) value = &json[*m_pointer];
+            } else {
+                auto it = json.find(m_key);
+                if(it != json.end()) value = &(*it);
+            }
+        }
+        if(!value) {
+            return m_next.fetch_add(1, std::memory_order_relaxed) % m_targets.size();
+        }
+        if(value->is_string())
+            return Hash(value->get_ref<const std::string&>()) % m_targets.size();
+        return Hash(value->dump()) % m_targets.size();
+    }
+
+    diaspora::Metadata metadata() const override {
+        auto json = nlohmann::json::object();
+        json["type"] = "key_hash";
+        json["key"]  = m_key;
+        return diaspora::Metadata{std::move(json)};
+    }
+
+    static std::shared_ptr<diaspora::PartitionSelectorInterface> create(
+            const diaspora::Metadata& metadata) {
+        const auto& json = metadata.json();
+        if(!json.is_object() || !json.contains("key") || !json["key"].is_string())
+            throw diaspora::Exception{
+                "key_hash PartitionSelector requires a \"key\" string field"};
+        return std::make_shared<KeyHashPartitionSelector>(json["key"].get<std::string>());
+    }
+
+    private:
+
+    static uint64_t Hash(std::string_view str) {
+        uint64_t h = 14695981039346656037ULL;
+        for(unsigned char c : str) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    std::string                                 m_key;
+    std::optional<nlohmann::json::json_pointer> m_pointer;
+    std::vector<diaspora::PartitionInfo>        m_targets;
+    std::atomic<size_t>                         m_next = 0;
+};
+
+}
+
+#endif
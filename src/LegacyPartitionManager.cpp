@@ -26,18 +26,45 @@ void LegacyPartitionManager::receiveBatch(
           const thallium::request& req,
           const std::string& producer_name,
           size_t num_events,
+          CompressionCodec metadata_codec,
           const BulkRef& metadata_bulk,
           const BulkRef& data_bulk)
 {
     (void)producer_name;
     Result<diaspora::EventID> first_id;
 
+    // --------- compressed metadata is pulled and decompressed first, and
+    // the EventStore is given a bulk exposing the decompressed metadata
+    std::vector<size_t> metadata_sizes;
+    std::vector<char>   metadata;
+    BulkRef             local_metadata_bulk;
+    if(metadata_codec != CompressionCodec::None) {
+        metadata_sizes.resize(num_events);
+        std::vector<char> compressed(metadata_bulk.size - num_events*sizeof(size_t));
+        auto pull_bulk = m_engine.expose(
+            {{(char*)metadata_sizes.data(), num_events*sizeof(size_t)},
+             {compressed.data(), compressed.size()}},
+            thallium::bulk_mode::write_only);
+        pull_bulk << metadata_bulk.handle.on(req.get_endpoint()).select(
+            metadata_bulk.offset, metadata_bulk.size);
+        DecompressMetadata(metadata_codec, metadata_sizes,
+                           compressed.data(), compressed.size(), metadata);
+        local_metadata_bulk.handle = m_engine.expose(
+            {{(char*)metadata_sizes.data(), num_events*sizeof(size_t)},
+             {metadata.data(), metadata.size()}},
+            thallium::bulk_mode::read_only);
+        local_metadata_bulk.offset  = 0;
+        local_metadata_bulk.size    = num_events*sizeof(size_t) + metadata.size();
+        local_metadata_bulk.address = static_cast<std::string>(m_engine.self());
+    }
+
     // --------- asynchronously transfer the data to the DataStore
     auto future_descriptors = m_data_store->store(num_events, data_bulk);
 
     // --------- meanwhile transfer the metadata to the EventStore
-    first_id = m_event_store->appendMetadata(num_events, metadata_bulk);
-    if(!first_id.success()) { req.respond(first_id); return; }
+    first_id = m_event_store->appendMetadata(
+        num_events, metadata_codec != CompressionCodec::None ? local_metadata_bulk : metadata_bulk);
+    if(!first_id.success()) { req.respond(first_id, load()); return; }
 
     // --------- wait for the data transfers
     std::vector<diaspora::DataDescriptor> descriptors;
@@ -46,7 +73,7 @@ void LegacyPartitionManager::receiveBatch(
     } catch(const std::exception& ex) {
         first_id.success() = false;
         first_id.error() = ex.what();
-        req.respond(first_id);
+        req.respond(first_id, load());
         return;
     }
 
@@ -55,13 +82,13 @@ void LegacyPartitionManager::receiveBatch(
     if(!ok.success()) {
         first_id.success() = false;
         first_id.error() = ok.error();
-        req.respond(first_id);
+        req.respond(first_id, load());
         return;
     }
 
     wakeUp();
 
-    req.respond(first_id);
+    req.respond(first_id, load());
 }
 
 void LegacyPartitionManager::wakeUp() {
@@ -75,6 +75,7 @@ class LegacyPartitionManager : public mofka::PartitionManager {
             const thallium::request& req,
             const std::string& producer_name,
             size_t num_events,
+            CompressionCodec metadata_codec,
             const BulkRef& metadata_bulk,
             const BulkRef& data_bulk) override;
 
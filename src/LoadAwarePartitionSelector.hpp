@@ -0,0 +1,156 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_LOAD_AWARE_PARTITION_SELECTOR_H
+#define MOFKA_LOAD_AWARE_PARTITION_SELECTOR_H
+
+#include "PartitionLoad.hpp"
+
+#include <diaspora/Metadata.hpp>
+#include <diaspora/PartitionSelector.hpp>
+#include <diaspora/Exception.hpp>
+
+#include <fmt/format.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief PartitionSelector that steers events away from busy partitions.
+ * Each batch response carries the number of batches and bytes the
+ * partition has received but not stored yet; together with the latency
+ * of the batch RPCs, producers of this process record it in a
+ * PartitionLoadStats shared with this selector.
+ *
+ * For each event, the selector picks two partitions at random and keeps
+ * the one with the lower cost ("power of two choices"), where
+ *
+ *     cost = latency_weight * latency_us
+ *          + queue_weight   * queue_depth
+ *          + bytes_weight   * pending_bytes / 2^20
+ *
+ * A partition whose statistics have not been updated for stale_after_us
+ * microseconds has a cost of 0 so that it gets probed again.
+ * Its configuration is of the form:
+ *
+ * {
+ *     "type": "load_aware",
+ *     "latency_weight": 1.0,
+ *     "queue_weight": 1000.0,
+ *     "bytes_weight": 100.0,
+ *     "stale_after_us": 1000000
+ * }
+ *
+ * selectPartitionFor is lock-free.
+ */
+class LoadAwarePartitionSelector : public diaspora::PartitionSelectorInterface {
+
+    public:
+
+    struct Weights {
+        double  latency        = 1.0;
+        double  queue          = 1000.0;
+        double  bytes          = 100.0;
+        int64_t stale_after_us = 1000000;
+    };
+
+    explicit LoadAwarePartitionSelector(const Weights& weights)
+    : m_weights{weights} {}
+
+    void setPartitions(const std::vector<diaspora::PartitionInfo>& targets) override {
+        m_targets = targets;
+        m_stats.clear();
+        m_stats.reserve(targets.size());
+        for(auto& target : m_targets) {
+            const auto& json = target.json();
+            std::string uuid;
+            if(json.is_object() && json.contains("uuid") && json["uuid"].is_string())
+                uuid = json["uuid"].get<std::string>();
+            m_stats.push_back(PartitionLoadStats::ForPartition(uuid));
+        }
+    }
+
+    size_t selectPartitionFor(const diaspora::Metadata& metadata,
+                              std::optional<size_t> requested) override {
+        (void)metadata;
+        if(m_targets.size() == 0)
+            throw diaspora::Exception("PartitionSelector has no target to select from");
+        if(requested.has_value())
+            return requested.value() % m_targets.size();
+        if(m_targets.size() == 1)
+            return 0;
+        const uint64_t r = Mix(m_counter.fetch_add(1, std::memory_order_relaxed));
+        const size_t n = m_targets.size();
+        size_t a = r % n;
+        size_t b = (a + 1 + (r >> 32) % (n - 1)) % n;
+        const auto now = PartitionLoadStats::Now().count();
+        return cost(a, now) <= cost(b, now) ? a : b;
+    }
+
+    diaspora::Metadata metadata() const override {
+        auto json = nlohmann::json::object();
+        json["type"]           = "load_aware";
+        json["latency_weight"] = m_weights.latency;
+        json["queue_weight"]   = m_weights.queue;
+        json["bytes_weight"]   = m_weights.bytes;
+        json["stale_after_us"] = m_weights.stale_after_us;
+        return diaspora::Metadata{std::move(json)};
+    }
+
+    static std::shared_ptr<diaspora::PartitionSelectorInterface> create(
+            const diaspora::Metadata& metadata) {
+        const auto& json = metadata.json();
+        Weights weights;
+        if(json.is_object()) {
+            auto get_number = [&json](const char* name, auto& field) {
+                if(!json.contains(name)) return;
+                if(!json[name].is_number())
+                    throw diaspora::Exception{fmt::format(
+                        "\"{}\" in load_aware PartitionSelector should be a number", name)};
+                field = json[name].get<std::decay_t<decltype(field)>>();
+            };
+            get_number("latency_weight", weights.latency);
+            get_number("queue_weight",   weights.queue);
+            get_number("bytes_weight",   weights.bytes);
+            get_number("stale_after_us", weights.stale_after_us);
+        }
+        return std::make_shared<LoadAwarePartitionSelector>(weights);
+    }
+
+    private:
+
+    double cost(size_t index, int64_t now) const {
+        const auto& stats = *m_stats[index];
+        auto last_update = stats.last_update_us.load(std::memory_order_relaxed);
+        if(last_update == 0 || now - last_update > m_weights.stale_after_us)
+            return 0.0;
+        return m_weights.latency * stats.latency_us.load(std::memory_order_relaxed)
+             + m_weights.queue   * stats.queue_depth.load(std::memory_order_relaxed)
+             + m_weights.bytes   * stats.pending_bytes.load(std::memory_order_relaxed) / (1024.0*1024.0);
+    }
+
+    /* splitmix64 finalizer, turns a counter into well-distributed bits */
+    static uint64_t Mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    Weights                                          m_weights;
+    std::vector<diaspora::PartitionInfo>             m_targets;
+    std::vector<std::shared_ptr<PartitionLoadStats>> m_stats;
+    std::atomic<uint64_t>                            m_counter = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * (C) 2023 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_MPSC_RING_BUFFER_H
+#define MOFKA_MPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace mofka {
+
+/**
+ * @brief Bounded, lock-free, multi-producer single-consumer ring buffer
+ * (based on Dmitry Vyukov's bounded queue). Any thread may call tryPush
+ * concurrently, but tryPop and empty may only be called by one consumer.
+ *
+ * @tparam T Type of element (must be default-constructible and
+ * move-assignable).
+ */
+template<typename T>
+class MPSCRingBuffer {
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    std::unique_ptr<Cell[]>          m_cells;
+    size_t                           m_mask;
+    alignas(64) std::atomic<size_t>  m_tail{0};
+    alignas(64) size_t               m_head = 0;
+
+    public:
+
+    /**
+     * @brief Constructor. The capacity is rounded up to a power of 2.
+     */
+    explicit MPSCRingBuffer(size_t capacity) {
+        size_t actual_capacity = 2;
+        while(actual_capacity < capacity) actual_capacity *= 2;
+        m_cells.reset(new Cell[actual_capacity]);
+        m_mask = actual_capacity - 1;
+        for(size_t i = 0; i < actual_capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MPSCRingBuffer(const MPSCRingBuffer&) = delete;
+    MPSCRingBuffer& operator=(const MPSCRingBuffer&) = delete;
+
+    /**
+     * @brief Pushes an element if the ring is not full. The element is
+     * only moved from if the call succeeds. If position is not null, it is
+     * set to the number of elements pushed before this one.
+     */
+    bool tryPush(T& value, size_t* position = nullptr) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for(;;) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        if(position) *position = pos;
+        return true;
+    }
+
+    /**
+     * @brief Pops the oldest element if there is one (consumer only).
+     */
+    bool tryPop(T& value) {
+        Cell& cell = m_cells[m_head & m_mask];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if((intptr_t)seq - (intptr_t)(m_head + 1) < 0)
+            return false;
+        value = std::move(cell.value);
+        cell.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    /**
+     * @brief Whether no element has been pushed, or is being pushed,
+     * that the consumer has not popped yet (consumer only).
+     */
+    bool empty() const {
+        return m_tail.load(std::memory_order_acquire) == m_head;
+    }
+
+    /**
+     * @brief Number of elements popped so far (consumer only).
+     */
+    size_t popped() const {
+        return m_head;
+    }
+
+    /**
+     * @brief Number of elements pushed, or being pushed, so far.
+     */
+    size_t pushed() const {
+        return m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+};
+
+}
+
+#endif
@@ -16,6 +16,7 @@ void MemoryPartitionManager::receiveBatch(
           const thallium::request& req,
           const std::string& producer_name,
           size_t num_events,
+          CompressionCodec metadata_codec,
           const BulkRef& metadata_bulk,
           const BulkRef& data_bulk)
 {
@@ -45,6 +46,12 @@ void MemoryPartitionManager::receiveBatch(
         local_metadata_bulk << metadata_bulk.handle.on(sender).select(
             metadata_bulk.offset, metadata_bulk.size);
     }
+    if(metadata_codec != CompressionCodec::None) {
+        std::vector<char> decompressed;
+        DecompressMetadata(metadata_codec, tmp_metadata_sizes,
+                           tmp_metadata.data(), tmp_metadata.size(), decompressed);
+        tmp_metadata = std::move(decompressed);
+    }
     {
         auto local_data_bulk = m_engine.expose(
             {{(char*)tmp_data_sizes.data(), num_events*sizeof(size_t)},
@@ -111,7 +118,7 @@ void MemoryPartitionManager::receiveBatch(
         m_events_cv.notify_all();
     }
     result.value() = first_id;
-    req.respond(result);
+    req.respond(result, load());
 }
 
 void MemoryPartitionManager::wakeUp() {
@@ -132,11 +139,11 @@ Result<void> MemoryPartitionManager::feedConsumer(
     }
 
     auto self_addr = static_cast<std::string>(m_engine.self());
-    {
-        auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
-        while(!consumerHandle.shouldStop()) {
-            size_t num_events_to_send;
-            bool should_stop = false;
+    while(!consumerHandle.shouldStop()) {
+        size_t num_events_to_send;
+        bool should_stop = false;
+        {
+            auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
             while(true) {
                 // find the number of events we can send
                 size_t max_available_events = m_events_metadata_sizes.size() - first_id;
@@ -145,63 +152,69 @@ Result<void> MemoryPartitionManager::feedConsumer(
                 if(num_events_to_send != 0 || should_stop) break;
                 m_events_cv.wait(g);
             }
-            if(should_stop) break;
+        }
+        if(should_stop) break;
 
-            if(num_events_to_send == 0) { // m_is_marked_complete must be true
-                // feed consumer 0 events with first_id = NoMoreEvents to indicate
-                // that there are no more events to consume from this partition
-                consumerHandle.feed(
-                        0, diaspora::NoMoreEvents, BulkRef{}, BulkRef{}, BulkRef{}, BulkRef{});
-                break;
-            }
+        if(num_events_to_send == 0) { // m_is_marked_complete must be true
+            // feed consumer 0 events with first_id = NoMoreEvents to indicate
+            // that there are no more events to consume from this partition
+            consumerHandle.feed(
+                    0, diaspora::NoMoreEvents, BulkRef{}, BulkRef{}, BulkRef{}, BulkRef{});
+            break;
+        }
 
-            // find the range of metadata sizes
-            const auto metadata_sizes_ptr = m_events_metadata_sizes.data() + first_id;
-            // find the metadata content
-            const auto metadata_ptr = m_events_metadata.data() + m_events_metadata_offsets[first_id];
-            const auto metadata_size = std::accumulate(
-                    metadata_sizes_ptr, metadata_sizes_ptr + num_events_to_send, (size_t)0);
-            // create the BulkRefs for the metadata sizes and contents
-            auto metadata_bulk = m_engine.expose(
-                    {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
-                     {metadata_ptr, metadata_size}},
-                    thallium::bulk_mode::read_only);
-            auto metadata_size_bulk_ref = BulkRef{
-                metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
-            };
-            auto metadata_bulk_ref = BulkRef{
-                metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr
-            };
+        // wait until the consumer has room for one more batch, without
+        // holding the lock so that producers are not blocked meanwhile
+        // (events are never removed, so the ones found above remain available)
+        if(!consumerHandle.acquireCredit()) break;
+        auto g = std::unique_lock<thallium::mutex>{m_events_metadata_mtx};
 
-            // find the range of descriptor sizes
-            const auto descriptors_sizes_ptr = m_events_data_desc_sizes.data() + first_id;
-            // find the descriptors content
-            const auto descriptors_ptr = m_events_data_desc.data() + m_events_data_desc_offsets[first_id];
-            const auto descriptors_size = std::accumulate(
-                    descriptors_sizes_ptr, descriptors_sizes_ptr + num_events_to_send, (size_t)0);
-            // create BulRefs for the descriptor sizes and contents
-            auto data_descriptors_bulk = m_engine.expose(
-                    {{descriptors_sizes_ptr, num_events_to_send*sizeof(size_t)},
-                     {descriptors_ptr, descriptors_size}},
-                    thallium::bulk_mode::read_only);
-            // create the BulkRefs for the data descriptors
-            auto data_desc_size_bulk_ref = BulkRef{
-                data_descriptors_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
-            };
-            auto data_desc_bulk_ref = BulkRef{
-                data_descriptors_bulk, num_events_to_send*sizeof(size_t), descriptors_size, self_addr
-            };
-            // feed consumer
-            consumerHandle.feed(
-                    num_events_to_send,
-                    first_id,
-                    metadata_size_bulk_ref,
-                    metadata_bulk_ref,
-                    data_desc_size_bulk_ref,
-                    data_desc_bulk_ref);
+        // find the range of metadata sizes
+        const auto metadata_sizes_ptr = m_events_metadata_sizes.data() + first_id;
+        // find the metadata content
+        const auto metadata_ptr = m_events_metadata.data() + m_events_metadata_offsets[first_id];
+        const auto metadata_size = std::accumulate(
+                metadata_sizes_ptr, metadata_sizes_ptr + num_events_to_send, (size_t)0);
+        // create the BulkRefs for the metadata sizes and contents
+        auto metadata_bulk = m_engine.expose(
+                {{metadata_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                 {metadata_ptr, metadata_size}},
+                thallium::bulk_mode::read_only);
+        auto metadata_size_bulk_ref = BulkRef{
+            metadata_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
+        };
+        auto metadata_bulk_ref = BulkRef{
+            metadata_bulk, num_events_to_send*sizeof(size_t), metadata_size, self_addr, true
+        };
 
-            first_id += num_events_to_send;
-        }
+        // find the range of descriptor sizes
+        const auto descriptors_sizes_ptr = m_events_data_desc_sizes.data() + first_id;
+        // find the descriptors content
+        const auto descriptors_ptr = m_events_data_desc.data() + m_events_data_desc_offsets[first_id];
+        const auto descriptors_size = std::accumulate(
+                descriptors_sizes_ptr, descriptors_sizes_ptr + num_events_to_send, (size_t)0);
+        // create BulRefs for the descriptor sizes and contents
+        auto data_descriptors_bulk = m_engine.expose(
+                {{descriptors_sizes_ptr, num_events_to_send*sizeof(size_t)},
+                 {descriptors_ptr, descriptors_size}},
+                thallium::bulk_mode::read_only);
+        // create the BulkRefs for the data descriptors
+        auto data_desc_size_bulk_ref = BulkRef{
+            data_descriptors_bulk, 0, num_events_to_send*sizeof(size_t), self_addr
+        };
+        auto data_desc_bulk_ref = BulkRef{
+            data_descriptors_bulk, num_events_to_send*sizeof(size_t), descriptors_size, self_addr, true
+        };
+        // feed consumer
+        consumerHandle.feed(
+                num_events_to_send,
+                first_id,
+                metadata_size_bulk_ref,
+                metadata_bulk_ref,
+                data_desc_size_bulk_ref,
+                data_desc_bulk_ref);
+
+        first_id += num_events_to_send;
     }
 
     return result;
@@ -94,6 +94,7 @@ class MemoryPartitionManager : public mofka::PartitionManager {
             const thallium::request& req,
             const std::string& producer_name,
             size_t num_events,
+            CompressionCodec metadata_codec,
             const BulkRef& metadata_bulk,
             const BulkRef& data_bulk) override;
 
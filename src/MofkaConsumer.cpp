@@ -18,12 +18,83 @@
 #include <diaspora/Future.hpp>
 #include <diaspora/BufferWrapperArchive.hpp>
 
+#include <thallium/serialization/stl/vector.hpp>
+
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <limits>
+#include <optional>
 
 using namespace std::string_literals;
 
 namespace mofka {
 
+/**
+ * @brief State shared between a process() call, the recvBatch ULTs that
+ * dispatch events to it, and the tasks running its processor.
+ */
+struct MofkaConsumer::ProcessContext {
+
+    diaspora::EventProcessor                       processor;
+    std::shared_ptr<diaspora::ThreadPoolInterface> pool;
+    size_t                                         max_events      = 0;
+    size_t                                         max_concurrency = 1;
+    bool                                           ordered         = false;
+
+    /* number of events handed to the processor (or about to be) */
+    std::atomic<size_t> claimed{0};
+    /* set when process() returns or the processor failed */
+    std::atomic<bool>   stopped{false};
+
+    /* fields below are protected by mutex */
+    thallium::mutex                       mutex;
+    thallium::condition_variable          cv;
+    size_t                                running   = 0;
+    size_t                                processed = 0;
+    std::vector<bool>                     partition_busy;
+    std::string                           error;
+    size_t                                skipped = 0;
+    std::string                           skipped_error;
+    std::chrono::steady_clock::time_point last_activity;
+
+    /**
+     * @brief Reserves up to n events out of max_events,
+     * returns the number of events reserved.
+     */
+    size_t claim(size_t n) {
+        size_t current = claimed.load(std::memory_order_relaxed);
+        size_t granted;
+        do {
+            if(stopped.load(std::memory_order_relaxed) || current >= max_events)
+                return 0;
+            granted = std::min(n, max_events - current);
+        } while(!claimed.compare_exchange_weak(current, current + granted));
+        return granted;
+    }
+
+    /**
+     * @brief Records an event that could not be handed to the processor
+     * (its data could not be fetched); the processing goes on.
+     */
+    void skip(const std::string& what) {
+        std::unique_lock<thallium::mutex> guard{mutex};
+        if(skipped_error.empty()) skipped_error = what;
+        skipped += 1;
+    }
+
+    /**
+     * @brief Records the first error and stops the processing.
+     */
+    void fail(const std::string& what) {
+        std::unique_lock<thallium::mutex> guard{mutex};
+        if(error.empty()) error = what;
+        stopped = true;
+        cv.notify_all();
+    }
+};
+
 std::shared_ptr<diaspora::TopicHandleInterface> MofkaConsumer::topic() const {
     return m_topic;
 }
@@ -31,7 +102,21 @@ std::shared_ptr<diaspora::TopicHandleInterface> MofkaConsumer::topic() const {
 diaspora::Future<std::optional<diaspora::Event>> MofkaConsumer::pull() {
     diaspora::Future<std::optional<diaspora::Event>> future;
     std::unique_lock<thallium::mutex> guard{m_futures_mtx};
-    if(m_futures_credit || m_futures.empty()) {
+    if(!m_ready_batches.empty()) {
+        // with pull_batches, received events wait in m_ready_batches,
+        // take the first one
+        auto& front = m_ready_batches.front();
+        Promise<std::optional<diaspora::Event>> promise;
+        std::tie(future, promise) = Promise<std::optional<diaspora::Event>>::CreateFutureAndPromise();
+        try {
+            promise.setValue(front.event(0));
+        } catch(const diaspora::Exception& ex) {
+            promise.setException(ex);
+        }
+        front.m_begin += 1;
+        front.m_batch->delivered(1);
+        if(front.empty()) m_ready_batches.pop_front();
+    } else if(m_futures_credit || m_futures.empty()) {
         // the queue of futures is empty or the futures
         // already in the queue have been created by
         // previous calls to pull() that haven't completed
@@ -40,7 +125,7 @@ diaspora::Future<std::optional<diaspora::Event>> MofkaConsumer::pull() {
         if(m_completed_partitions != m_partitions.size()) {
             // there are uncompleted partitions, put the future in the queue
             // and it will be picked up by a recvBatch RPC from any partition
-            m_futures.emplace_back(std::move(promise), future);
+            m_futures.push_back({std::move(promise), future, nullptr});
             m_futures_credit = true;
         } else {
             // all partitions are completed, create a NoMoreEvents event
@@ -51,9 +136,11 @@ diaspora::Future<std::optional<diaspora::Event>> MofkaConsumer::pull() {
     } else {
         // the queue of futures has futures already
         // created by the consumer
-        future = std::move(m_futures.front().second);
+        future = std::move(m_futures.front().future);
+        auto batch = std::move(m_futures.front().batch);
         m_futures.pop_front();
         m_futures_credit = false;
+        if(batch) batch->delivered(1);
     }
     return future;
 }
@@ -71,7 +158,7 @@ void MofkaConsumer::subscribe() {
                 auto consumer_ptr = reinterpret_cast<intptr_t>(this);
                 Result<void> result = rpc.on(ph)(
                     consumer_ptr, (size_t)i, m_name,
-                    (size_t)0, m_batch_size.value);
+                    (size_t)0, m_batch_size.value, creditWindow());
                 ult_completed[i].set_value();
             }
         );
@@ -116,15 +203,17 @@ void MofkaConsumer::unsubscribe() {
 
 void MofkaConsumer::partitionCompleted() {
     m_completed_partitions += 1;
+    notifyProcess();
     // check if there will be no more events any more, if so, set
     // the promise of all the pending Futures to NoMoreEvents.
     std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+    m_ready_batches_cv.notify_all();
     if(m_completed_partitions != m_partitions.size())
         return;
     if(!m_futures_credit)
         return;
     while(!m_futures.empty()) {
-        auto promise = std::move(m_futures.front().first);
+        auto promise = std::move(m_futures.front().promise);
         m_futures.pop_front();
         m_futures_credit = true;
         promise.setValue(diaspora::Event{std::make_shared<MofkaEvent>()});
@@ -141,16 +230,29 @@ void MofkaConsumer::recvBatch(const tl::request& req,
                               const BulkRef &data_desc) {
 
     auto batch = std::make_shared<ConsumerBatchImpl>(
-        m_engine, count, metadata.size, data_desc.size);
-    batch->pullFrom(metadata_sizes, metadata, data_desc_sizes, data_desc);
+        m_recv_buffer_pool, count, metadata.size, data_desc.size);
+    batch->pullFrom([this](const std::string& address) { return lookup(address); },
+                    metadata_sizes, metadata, data_desc_sizes, data_desc);
+    batch->prepare(startID, m_partitions[partition_index],
+                   m_topic->m_serializer, m_name, m_consumer_ack_event);
+    if(creditWindow() != 0)
+        batch->m_on_delivered = [this, partition_index]() { returnCredit(partition_index); };
 
     std::vector<Promise<std::optional<diaspora::Event>>> promises;
-    promises.reserve(count);
+    std::shared_ptr<ProcessContext> process_ctx;
+    size_t taken_by_pull = 0;
+    const uint64_t ticket = m_received_batches[partition_index].fetch_add(1);
 
-    // Create all the Future/Promise pairs first (to avoid locking over and over)
+    // Create all the Future/Promise pairs first (to avoid locking over and over),
+    // unless process() is running and no pull() is waiting for events, or the
+    // events are delivered as batches
     {
         std::unique_lock<thallium::mutex> guard{m_futures_mtx};
-        for(size_t i = 0; i < count; ++i) {
+        if(m_process_ctx && !(m_futures_credit && !m_futures.empty()))
+            process_ctx = m_process_ctx;
+        else if(!m_pull_batches)
+            promises.reserve(count);
+        for(size_t i = 0; !process_ctx && !m_pull_batches && i < count; ++i) {
             // get a promise/future pair
             Promise<std::optional<diaspora::Event>> promise;
             if(!m_futures_credit || m_futures.empty()) {
@@ -160,72 +262,149 @@ void MofkaConsumer::recvBatch(const tl::request& req,
                 // a corresponding pull() call from the user.
                 diaspora::Future<std::optional<diaspora::Event>> future;
                 std::tie(future, promise) = Promise<std::optional<diaspora::Event>>::CreateFutureAndPromise();
-                m_futures.emplace_back(promise, future);
+                m_futures.push_back({promise, future, batch});
                 m_futures_credit = false;
             } else {
                 // the queue of futures has futures already
                 // created by pull() calls from the user
-                promise = std::move(m_futures.front().first);
+                promise = std::move(m_futures.front().promise);
                 m_futures.pop_front();
                 m_futures_credit = true;
+                taken_by_pull += 1;
             }
             promises.push_back(std::move(promise));
         }
     }
+    batch->delivered(taken_by_pull);
+
+    // count the ULT before responding, so that a partition completing
+    // right after cannot be mistaken for the end of the stream
+    m_pending_ults.fetch_add(1, std::memory_order_relaxed);
 
     Result<void> result;
     req.respond(result);
 
-    m_pending_ults.fetch_add(1, std::memory_order_relaxed);
-    auto ult = [this,
-                count, startID, batch = std::move(batch),
-                serializer = m_topic->m_serializer,
-                partition = m_partitions[partition_index],
+    auto ult = [this, batch = std::move(batch),
+                partition_index, ticket,
+                process_ctx = std::move(process_ctx),
                 promises = std::move(promises)]() mutable {
 
-        size_t metadata_offset  = 0;
+        const size_t count = batch->count();
+        auto& partition = batch->m_partition;
+        auto& metadata  = batch->m_metadata;
+        auto& data      = batch->m_data;
+        std::vector<diaspora::DataDescriptor> descriptors(count);
+
+        // metadata is deserialized when the application first accesses it,
+        // unless the DataSelector or DataAllocator needs it here
+        const bool deliver_batches = m_pull_batches && !process_ctx;
+        const bool eager = m_data_selector || m_data_allocator;
+        auto make_event = [&](size_t i) {
+            return ConsumerBatchImpl::MakeEvent(
+                batch, i, std::move(data[i].value()),
+                eager ? std::make_optional(std::move(metadata[i])) : std::nullopt);
+        };
+
         size_t data_desc_offset = 0;
 
-        // Deserialize each event
-        for(size_t i = 0; i < count; ++i) {
-            auto eventID = startID + i;
-            try {
-                // deserialize its metadata
-                auto metadata = diaspora::Metadata{};
-                diaspora::BufferWrapperInputArchive metadata_archive{
-                    std::string_view{
-                        batch->m_meta_buffer.data() + metadata_offset,
-                        batch->m_meta_sizes[i]}};
-                serializer.deserialize(metadata_archive, metadata);
-                // deserialize the data descriptors
-                diaspora::DataDescriptor descriptor;
-                if(batch->m_data_desc_sizes[i] > 0) {
-                    diaspora::BufferWrapperInputArchive descriptors_archive{
-                        std::string_view{
-                            batch->m_data_desc_buffer.data() + data_desc_offset,
-                            batch->m_data_desc_sizes[i]}};
-                    descriptor.load(descriptors_archive);
+        // Data is requested in windows of at most m_data_request_max_events
+        // events, with up to m_data_prefetch_window requests in flight, so
+        // that deserializing the next window overlaps with the transfers.
+        const size_t window = m_data_request_max_events == 0
+                            ? count : m_data_request_max_events;
+        std::deque<DataRequest> in_flight;
+
+        // batches of a partition are retired in the order they were received,
+        // and when delivered as batches or with ordered processing they are
+        // also handed to the application in that order
+        const bool ordered = process_ctx && process_ctx->ordered;
+        bool has_turn = false;
+        auto wait_turn = [&]() {
+            if(has_turn) return;
+            std::unique_lock<thallium::mutex> guard{m_delivery_mtx};
+            m_delivery_cv.wait(guard, [&]() {
+                return m_delivered_batches[partition_index] == ticket;
+            });
+            has_turn = true;
+        };
+
+        auto complete_oldest = [&]() {
+            auto& request = in_flight.front();
+            completeDataRequest(request, data);
+            if(deliver_batches) {
+                // batches of a partition are queued in the order it sent them
+                wait_turn();
+                pushReadyBatch(MofkaEventBatch{batch, request.begin, request.end});
+                in_flight.pop_front();
+                return;
+            }
+            if(process_ctx) {
+                // hand the events to process() as a single task
+                std::vector<diaspora::Event> events;
+                events.reserve(request.end - request.begin);
+                for(size_t i = request.begin; i < request.end; ++i) {
+                    if(!data[i].success()) {
+                        process_ctx->skip(data[i].error());
+                        batch->delivered(1);
+                        continue;
+                    }
+                    events.emplace_back(make_event(i));
+                }
+                if(ordered) wait_turn();
+                dispatchToProcessor(process_ctx, partition_index, batch, std::move(events));
+                in_flight.pop_front();
+                return;
+            }
+            // create the events and set the promises
+            for(size_t i = request.begin; i < request.end; ++i) {
+                if(!data[i].success()) {
+                    // something bad happened somewhere,
+                    // pass the exception to the promise.
+                    promises[i].setException(diaspora::Exception{data[i].error()});
+                    continue;
                 }
-                // request Data associated with the event
-                auto data = requestData(
-                    partition, metadata,
-                    descriptor);
-                // create the event
-                auto event = std::make_shared<MofkaEvent>(
-                        eventID, partition,
-                        std::move(metadata), std::move(data),
-                        m_name, m_consumer_ack_event
-                );
-                // set the promise
-                promises[i].setValue(diaspora::Event{std::move(event)});
-            } catch(const diaspora::Exception& ex) {
-                // something bad happened somewhere,
-                // pass the exception to the promise.
-                promises[i].setException(ex);
+                promises[i].setValue(diaspora::Event{make_event(i)});
             }
-            metadata_offset  += batch->m_meta_sizes[i];
-            data_desc_offset += batch->m_data_desc_sizes[i];
+            in_flight.pop_front();
+        };
+
+        for(size_t begin = 0; begin < count; begin += window) {
+            size_t end = std::min(begin + window, count);
+            // Deserialize each event
+            for(size_t i = begin; eager && i < end; ++i) {
+                try {
+                    // deserialize its metadata
+                    batch->metadata(i);
+                    // deserialize the data descriptors
+                    if(batch->m_data_desc_sizes[i] > 0) {
+                        diaspora::BufferWrapperInputArchive descriptors_archive{
+                            std::string_view{
+                                batch->m_data_desc_buffer.data() + data_desc_offset,
+                                batch->m_data_desc_sizes[i]}};
+                        descriptors[i].load(descriptors_archive);
+                    }
+                } catch(const diaspora::Exception& ex) {
+                    data[i].success() = false;
+                    data[i].error()   = ex.what();
+                }
+                data_desc_offset += batch->m_data_desc_sizes[i];
+            }
+            // request the Data associated with these events
+            in_flight.push_back(startDataRequest(
+                partition, metadata, descriptors, data, begin, end));
+            if(in_flight.size() >= m_data_prefetch_window)
+                complete_oldest();
+        }
+        while(!in_flight.empty())
+            complete_oldest();
+
+        {
+            wait_turn();
+            std::unique_lock<thallium::mutex> guard{m_delivery_mtx};
+            m_delivered_batches[partition_index] += 1;
+            m_delivery_cv.notify_all();
         }
+        notifyProcess();
 
         // Signal completion so unsubscribe() can proceed. The consumer is
         // kept alive by Consumer::~Consumer(), which calls unsubscribe()
@@ -233,63 +412,430 @@ void MofkaConsumer::recvBatch(const tl::request& req,
         // shared_ptr — so `this` is guaranteed to be valid here.
         m_pending_ults.fetch_sub(1, std::memory_order_acq_rel);
         m_pending_ults_cv.notify_all();
+        if(m_pull_batches) {
+            // pullBatch() may be waiting for the last ULT to report the end
+            std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+            m_ready_batches_cv.notify_all();
+        }
     };
     m_thread_pool->pushWork(std::move(ult));
 }
 
-diaspora::DataView MofkaConsumer::requestData(
+struct MofkaConsumer::DataRequest {
+    size_t                              begin = 0;
+    size_t                              end   = 0;
+    std::vector<size_t>                 indices;
+    thallium::bulk                      bulk;
+    std::optional<thallium::async_response> response;
+    std::string                         error;
+};
+
+MofkaConsumer::DataRequest MofkaConsumer::startDataRequest(
         std::shared_ptr<MofkaPartitionInfo> partition,
-        diaspora::Metadata metadata,
-        const diaspora::DataDescriptor& descriptor) {
-
-    // run data selector
-    diaspora::DataDescriptor requested_descriptor = m_data_selector
-        ? m_data_selector(metadata, descriptor)
-        : diaspora::DataDescriptor();
-
-    // run data broker
-    auto data = m_data_allocator
-        ? m_data_allocator(metadata, requested_descriptor)
-        : diaspora::DataView{};
-
-    // check the size of the allocated data
-    if(data.size() != requested_descriptor.size()) {
-        throw diaspora::Exception(
-                "DataBroker returned a Data object with a "
-                "size different from the selected DataDescriptor size");
+        const std::vector<diaspora::Metadata>& metadata,
+        const std::vector<diaspora::DataDescriptor>& descriptors,
+        std::vector<Result<diaspora::DataView>>& data,
+        size_t begin, size_t end) {
+
+    DataRequest request;
+    request.begin = begin;
+    request.end   = end;
+
+    std::vector<Cerealized<diaspora::DataDescriptor>> requested_descriptors;
+    std::vector<std::pair<void*, size_t>>             segments;
+    size_t                                            total_size = 0;
+
+    for(size_t i = begin; i < end; ++i) {
+        if(!data[i].success()) continue;
+        try {
+            // run data selector
+            diaspora::DataDescriptor requested_descriptor = m_data_selector
+                ? m_data_selector(metadata[i], descriptors[i])
+                : diaspora::DataDescriptor();
+
+            // run data broker
+            auto view = m_data_allocator
+                ? m_data_allocator(metadata[i], requested_descriptor)
+                : diaspora::DataView{};
+
+            // check the size of the allocated data
+            if(view.size() != requested_descriptor.size()) {
+                throw diaspora::Exception(
+                        "DataBroker returned a Data object with a "
+                        "size different from the selected DataDescriptor size");
+            }
+            if(view.size() != 0) {
+                for(auto& s : view.segments()) {
+                    if(s.size == 0) continue;
+                    segments.emplace_back((void*)s.ptr, s.size);
+                }
+                total_size += view.size();
+                requested_descriptors.emplace_back(std::move(requested_descriptor));
+                request.indices.push_back(i);
+            }
+            data[i].value() = std::move(view);
+        } catch(const diaspora::Exception& ex) {
+            data[i].success() = false;
+            data[i].error()   = ex.what();
+        }
+    }
+
+    if(total_size == 0) return request;
+
+    try {
+        // expose the destination of all the events for RDMA as a single bulk;
+        // the provider packs the selected data in descriptor order, which
+        // matches the order of the segments
+        request.bulk = m_engine.expose(segments, thallium::bulk_mode::write_only);
+        auto local_bulk_ref = BulkRef{request.bulk, 0, total_size, m_self_addr};
+
+        // request data
+        auto& rpc = m_consumer_request_data_batch;
+        auto& ph  = partition->m_ph;
+        request.response = rpc.on(ph).async(requested_descriptors, local_bulk_ref);
+    } catch(const std::exception& ex) {
+        request.error = ex.what();
+    }
+    return request;
+}
+
+void MofkaConsumer::completeDataRequest(
+        DataRequest& request,
+        std::vector<Result<diaspora::DataView>>& data) {
+
+    auto fail_all = [&](const std::string& error) {
+        for(auto i : request.indices) {
+            data[i].success() = false;
+            data[i].error()   = error;
+        }
+    };
+
+    if(!request.error.empty()) {
+        fail_all(request.error);
+        return;
     }
-    if(data.size() == 0) {
-        return data;
+    if(!request.response) return;
+
+    Result<std::vector<Result<void>>> result;
+    try {
+        result = request.response->wait();
+    } catch(const std::exception& ex) {
+        fail_all(ex.what());
+        return;
+    }
+
+    if(!result.success()) {
+        fail_all(result.error());
+        return;
+    }
+
+    auto& results = result.value();
+    for(size_t j = 0; j < request.indices.size(); ++j) {
+        auto& d = data[request.indices[j]];
+        if(j >= results.size()) {
+            d.success() = false;
+            d.error()   = "Provider returned fewer results than requested descriptors";
+        } else if(!results[j].success()) {
+            d.success() = false;
+            d.error()   = results[j].error();
+        }
+    }
+}
+
+void MofkaConsumer::process(
+        diaspora::EventProcessor processor,
+        int timeout_ms,
+        diaspora::NumEvents maxEvents,
+        std::shared_ptr<diaspora::ThreadPoolInterface> threadPool) {
+
+    auto ctx = std::make_shared<ProcessContext>();
+    ctx->processor       = std::move(processor);
+    ctx->pool            = threadPool ? std::move(threadPool) : m_thread_pool;
+    ctx->max_events      = maxEvents.value;
+    ctx->max_concurrency = m_process_max_concurrency;
+    ctx->ordered         = m_process_ordered;
+    ctx->partition_busy.resize(m_partitions.size(), false);
+    ctx->last_activity   = std::chrono::steady_clock::now();
+
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        if(m_process_ctx)
+            throw diaspora::Exception{"MofkaConsumer::process is already running"};
     }
 
-    // expose the local_data_partition for RDMA
-    std::vector<std::pair<void*, size_t>> segments;
-    segments.reserve(data.segments().size());
-    for(auto& s : data.segments()) {
-        segments.emplace_back((void*)s.ptr, s.size);
+    // events already received (and not pulled) are processed first,
+    // on the calling thread; once there are none left, the context is
+    // installed and recvBatch dispatches new batches to it
+    while(true) {
+        diaspora::Future<std::optional<diaspora::Event>> future;
+        {
+            std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+            if(m_futures_credit || m_futures.empty()) {
+                m_process_ctx = ctx;
+                break;
+            }
+            if(ctx->claim(1) == 0) break;
+            future = std::move(m_futures.front().future);
+            if(m_futures.front().batch) m_futures.front().batch->delivered(1);
+            m_futures.pop_front();
+        }
+        std::optional<diaspora::Event> event;
+        try {
+            event = future.wait(-1);
+        } catch(const std::exception& ex) {
+            // the event could not be completed, it does not count
+            ctx->claimed -= 1;
+            ctx->skip(ex.what());
+            continue;
+        }
+        try {
+            if(event) ctx->processor(*event);
+        } catch(const std::exception& ex) {
+            ctx->fail(ex.what());
+        }
+        std::unique_lock<thallium::mutex> guard{ctx->mutex};
+        ctx->processed += 1;
+        ctx->last_activity = std::chrono::steady_clock::now();
     }
-    auto local_bulk_ref = BulkRef{
-        m_engine.expose(segments, thallium::bulk_mode::write_only),
-            0, data.size(),
-            m_self_addr
+
+    // wait until we are done
+    auto all_delivered = [this]() {
+        std::unique_lock<thallium::mutex> guard{m_delivery_mtx};
+        for(size_t i = 0; i < m_partitions.size(); ++i) {
+            if(m_delivered_batches[i] != m_received_batches[i].load())
+                return false;
+        }
+        return true;
     };
+    {
+        std::unique_lock<thallium::mutex> guard{ctx->mutex};
+        auto done = [&]() {
+            return ctx->stopped
+                || ctx->processed >= ctx->max_events
+                || (ctx->running == 0
+                    && m_completed_partitions == m_partitions.size()
+                    && all_delivered());
+        };
+        while(!done()) {
+            if(timeout_ms <= 0 || ctx->running != 0) {
+                ctx->cv.wait(guard);
+                continue;
+            }
+            auto deadline = ctx->last_activity + std::chrono::milliseconds{timeout_ms};
+            if(std::chrono::steady_clock::now() >= deadline)
+                break;
+            ctx->cv.wait_until(guard, deadline);
+        }
+        ctx->stopped = true;
+        ctx->cv.notify_all();
+    }
 
-    // request data
-    auto& rpc = m_consumer_request_data;
-    auto& ph  = partition->m_ph;
+    // stop dispatching new batches to this call, then wait
+    // for the tasks that are still running
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        if(m_process_ctx == ctx) m_process_ctx.reset();
+    }
+    std::unique_lock<thallium::mutex> guard{ctx->mutex};
+    ctx->cv.wait(guard, [&]() { return ctx->running == 0; });
+    if(!ctx->error.empty())
+        throw diaspora::Exception{ctx->error};
+    if(ctx->skipped != 0)
+        throw diaspora::Exception{fmt::format(
+            "{} event(s) were not processed because their data could not be fetched"
+            " (first error: {})", ctx->skipped, ctx->skipped_error)};
+}
+
+void MofkaConsumer::dispatchToProcessor(
+        const std::shared_ptr<ProcessContext>& ctx,
+        size_t partition_index,
+        const std::shared_ptr<ConsumerBatchImpl>& batch,
+        std::vector<diaspora::Event> events) {
 
-    Result<std::vector<Result<void>>> result = rpc.on(ph)(
-            Cerealized<diaspora::DataDescriptor>(requested_descriptor),
-            local_bulk_ref);
+    if(events.empty()) return;
 
-    if(!result.success())
-        throw diaspora::Exception(result.error());
+    // events beyond the maximum requested by process() are left for pull()
+    const size_t granted = ctx->claim(events.size());
+    for(size_t i = granted; i < events.size(); ++i)
+        pushToPullQueue(std::move(events[i]), batch);
+    events.resize(granted);
+    if(events.empty()) return;
 
-    if(!result.value()[0].success()) {
-        throw diaspora::Exception(result.value()[0].error());
+    // wait for a free task slot (and, for ordered processing,
+    // for the previous task of this partition to complete)
+    bool accepted = false;
+    {
+        std::unique_lock<thallium::mutex> guard{ctx->mutex};
+        ctx->cv.wait(guard, [&]() {
+            return ctx->stopped
+                || (ctx->running < ctx->max_concurrency
+                    && !(ctx->ordered && ctx->partition_busy[partition_index]));
+        });
+        if(!ctx->stopped) {
+            ctx->running += 1;
+            ctx->partition_busy[partition_index] = true;
+            accepted = true;
+        }
+    }
+    if(!accepted) {
+        for(auto& event : events) pushToPullQueue(std::move(event), batch);
+        return;
     }
 
-    return data;
+    ctx->pool->pushWork(
+        [this, ctx, partition_index, batch, events = std::move(events)]() mutable {
+            size_t done = 0;
+            for(; done < events.size() && !ctx->stopped; ++done) {
+                try {
+                    ctx->processor(events[done]);
+                } catch(const std::exception& ex) {
+                    ctx->fail(ex.what());
+                }
+            }
+            // the processor failed, leave the remaining events for pull()
+            batch->delivered(done);
+            for(size_t i = done; i < events.size(); ++i)
+                pushToPullQueue(std::move(events[i]), batch);
+            std::unique_lock<thallium::mutex> guard{ctx->mutex};
+            ctx->running   -= 1;
+            ctx->processed += done;
+            ctx->partition_busy[partition_index] = false;
+            ctx->last_activity = std::chrono::steady_clock::now();
+            ctx->cv.notify_all();
+        }
+    );
+}
+
+size_t MofkaConsumer::creditWindow() const {
+    auto window = m_max_batch.value;
+    if(window == std::numeric_limits<size_t>::max()) return 0;
+    return window;
+}
+
+void MofkaConsumer::returnCredit(size_t partition_index) {
+    auto window = creditWindow();
+    if(window == 0) return;
+    // credits are returned in groups of half a window to limit the number of RPCs
+    auto threshold = std::max<size_t>(1, window/2);
+    auto& pending = m_credits_to_return[partition_index];
+    if(pending.fetch_add(1) + 1 < threshold) return;
+    auto count = pending.exchange(0);
+    if(count == 0) return;
+    auto rpc = m_consumer_grant_credits;
+    auto ph = m_partitions[partition_index]->m_ph;
+    auto consumer_ptr = reinterpret_cast<intptr_t>(this);
+    m_thread_pool->pushWork(
+        [rpc, ph, consumer_ptr, partition_index, count]() {
+            // failures are ignored: the partition may already have
+            // removed this consumer, in which case credits are moot
+            try {
+                Result<void> result = rpc.on(ph)(consumer_ptr, partition_index, count);
+            } catch(const std::exception&) {}
+        }
+    );
+}
+
+thallium::endpoint MofkaConsumer::lookup(const std::string& address) {
+    std::unique_lock<thallium::mutex> guard{m_endpoints_mtx};
+    auto it = m_endpoints.find(address);
+    if(it != m_endpoints.end()) return it->second;
+    auto endpoint = m_engine.lookup(address);
+    m_endpoints.emplace(address, endpoint);
+    return endpoint;
+}
+
+void MofkaConsumer::pushToPullQueue(diaspora::Event event, std::shared_ptr<ConsumerBatchImpl> batch) {
+    Promise<std::optional<diaspora::Event>> promise;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        if(!m_futures_credit || m_futures.empty()) {
+            diaspora::Future<std::optional<diaspora::Event>> future;
+            std::tie(future, promise) = Promise<std::optional<diaspora::Event>>::CreateFutureAndPromise();
+            m_futures.push_back({promise, future, std::move(batch)});
+            m_futures_credit = false;
+        } else {
+            promise = std::move(m_futures.front().promise);
+            m_futures.pop_front();
+            m_futures_credit = true;
+            batch->delivered(1);
+        }
+    }
+    promise.setValue(std::move(event));
+}
+
+void MofkaConsumer::pushReadyBatch(MofkaEventBatch batch) {
+    // events requested by pull() calls are served first
+    std::vector<std::pair<Promise<std::optional<diaspora::Event>>, size_t>> waiting;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        while(m_futures_credit && !m_futures.empty() && !batch.empty()) {
+            waiting.emplace_back(std::move(m_futures.front().promise), batch.m_begin);
+            m_futures.pop_front();
+            batch.m_begin += 1;
+        }
+        if(!batch.empty()) {
+            m_ready_batches.push_back(batch);
+            m_ready_batches_cv.notify_all();
+        }
+    }
+    batch.m_batch->delivered(waiting.size());
+    for(auto& [promise, index] : waiting) {
+        try {
+            promise.setValue(MofkaEventBatch{batch.m_batch, index, index + 1}.event(0));
+        } catch(const diaspora::Exception& ex) {
+            promise.setException(ex);
+        }
+    }
+}
+
+MofkaEventBatch MofkaConsumer::pullBatch(size_t maxEvents, int timeout_ms) {
+    if(!m_pull_batches)
+        throw diaspora::Exception{
+            "MofkaConsumer::pullBatch requires the consumer to be created "
+            "with the \"pull_batches\" option"};
+    auto no_more_events = [this]() {
+        return m_completed_partitions == m_partitions.size()
+            && m_pending_ults.load(std::memory_order_acquire) == 0;
+    };
+    auto ready = [&]() {
+        return !m_ready_batches.empty() || no_more_events();
+    };
+    std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+    if(timeout_ms < 0) {
+        m_ready_batches_cv.wait(guard, ready);
+    } else if(timeout_ms > 0) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{timeout_ms};
+        while(!ready() && std::chrono::steady_clock::now() < deadline)
+            m_ready_batches_cv.wait_until(guard, deadline);
+    }
+    if(m_ready_batches.empty()) {
+        MofkaEventBatch result;
+        result.m_no_more_events = no_more_events();
+        return result;
+    }
+    auto& front = m_ready_batches.front();
+    MofkaEventBatch result;
+    if(maxEvents == 0 || front.size() <= maxEvents) {
+        result = std::move(front);
+        m_ready_batches.pop_front();
+    } else {
+        result = front;
+        result.m_end = result.m_begin + maxEvents;
+        front.m_begin = result.m_end;
+    }
+    result.m_batch->delivered(result.size());
+    return result;
+}
+
+void MofkaConsumer::notifyProcess() {
+    std::shared_ptr<ProcessContext> ctx;
+    {
+        std::unique_lock<thallium::mutex> guard{m_futures_mtx};
+        ctx = m_process_ctx;
+    }
+    if(!ctx) return;
+    std::unique_lock<thallium::mutex> guard{ctx->mutex};
+    ctx->cv.notify_all();
 }
 
 void MofkaConsumer::forwardBatchToConsumer(
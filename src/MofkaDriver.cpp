@@ -13,6 +13,7 @@
 #include "mofka/MofkaTopicHandle.hpp"
 #include "mofka/MofkaDriver.hpp"
 #include "mofka/MofkaThreadPool.hpp"
+#include "mofka/Compression.hpp"
 
 #include <bedrock/Client.hpp>
 #include <spdlog/spdlog.h>
@@ -160,6 +161,7 @@ void MofkaDriver::createTopic(
     std::string    partition_type         = "memory";
     nlohmann::json partition_config       = nlohmann::json::object();
     Dependencies   partition_dependencies;
+    CompressionConfig compression;
     if(options.json().is_object()) {
         if(options.json().contains("num_partitions")) {
             if(!options.json()["num_partitions"].is_number())
@@ -207,48 +209,59 @@ void MofkaDriver::createTopic(
                 }
             }
         }
+        if(options.json().contains("compression")) {
+            compression = CompressionConfig::FromMetadata(
+                diaspora::Metadata{options.json()["compression"]});
+            if(!CompressionConfig::IsAvailable(compression.codec))
+                throw diaspora::Exception{
+                    "Compression codec requested in options is not available in this build"};
+        }
     }
     spdlog::trace("[mofka:client] Creating topic {}", name);
     // A topic's informations are stored in the service' master database
     // with the keys prefixed "MOFKA:GLOBAL:<name>:". The validator is
     // located at key "MOFKA:GLOBAL:<name>:validator", and respectively
-    // for the selector and serializer.
+    // for the selector, serializer, and compression settings.
     //
     // The partitions are managed in a collection named
     // "MOFKA:GLOBAL:{}:partitions. The topic is created without any partition.
     // The partitions need to be added using MofkaDriver::add*Partition().
-    std::array<std::string, 3> keys = {
-        fmt::format("MOFKA:GLOBAL:{}:validator",  name),
-        fmt::format("MOFKA:GLOBAL:{}:selector",   name),
-        fmt::format("MOFKA:GLOBAL:{}:serializer", name),
+    std::array<std::string, 4> keys = {
+        fmt::format("MOFKA:GLOBAL:{}:validator",   name),
+        fmt::format("MOFKA:GLOBAL:{}:selector",    name),
+        fmt::format("MOFKA:GLOBAL:{}:serializer",  name),
+        fmt::format("MOFKA:GLOBAL:{}:compression", name),
     };
-    std::array<const void*, 3> keysPtrs = {
-        keys[0].data(), keys[1].data(), keys[2].data()
+    std::array<const void*, 4> keysPtrs = {
+        keys[0].data(), keys[1].data(), keys[2].data(), keys[3].data()
     };
-    std::array<size_t, 3> ksizes = {
-        keys[0].size(), keys[1].size(), keys[2].size()
+    std::array<size_t, 4> ksizes = {
+        keys[0].size(), keys[1].size(), keys[2].size(), keys[3].size()
     };
-    std::array<std::string, 3> values = {
+    std::array<std::string, 4> values = {
         validator->metadata().json().dump(),
         selector->metadata().json().dump(),
-        serializer->metadata().json().dump()};
-    std::array<const void*, 3> valuesPtrs = {
+        serializer->metadata().json().dump(),
+        compression.toMetadata().json().dump()};
+    std::array<const void*, 4> valuesPtrs = {
         values[0].c_str(),
         values[1].c_str(),
-        values[2].c_str()
+        values[2].c_str(),
+        values[3].c_str()
     };
-    std::array<size_t, 3> vsizes = {
+    std::array<size_t, 4> vsizes = {
         values[0].size(),
         values[1].size(),
-        values[2].size()
+        values[2].size(),
+        values[3].size()
     };
     // put the keys in the database. If any already exists,
     // this call will fail with YOKAN_ERR_KEY_EXISTS.
     try {
         spdlog::trace("[mofka:client] Storing topic information"
-                      " (validator, selector, serializer) in master database "
+                      " (validator, selector, serializer, compression) in master database "
                       " for topic {}", name);
-        m_yk_master_db.putMulti(3,
+        m_yk_master_db.putMulti(4,
             keysPtrs.data(), ksizes.data(),
             valuesPtrs.data(), vsizes.data(),
             YOKAN_MODE_NEW_ONLY|YOKAN_MODE_NO_RDMA);
@@ -316,24 +329,27 @@ void MofkaDriver::createTopic(
 
 std::shared_ptr<diaspora::TopicHandleInterface> MofkaDriver::openTopic(std::string_view name) const {
     spdlog::trace("[mofka:client] Opening topic {}", name);
-    // craft the keys for the topic's validator, selector and serializer
-    std::array<std::string, 3> keys = {
-        fmt::format("MOFKA:GLOBAL:{}:validator",  name),
-        fmt::format("MOFKA:GLOBAL:{}:selector",   name),
-        fmt::format("MOFKA:GLOBAL:{}:serializer", name),
+    // craft the keys for the topic's validator, selector, serializer,
+    // and compression settings (the latter may be absent for topics
+    // created by older versions of Mofka)
+    std::array<std::string, 4> keys = {
+        fmt::format("MOFKA:GLOBAL:{}:validator",   name),
+        fmt::format("MOFKA:GLOBAL:{}:selector",    name),
+        fmt::format("MOFKA:GLOBAL:{}:serializer",  name),
+        fmt::format("MOFKA:GLOBAL:{}:compression", name),
     };
-    std::array<const void*, 3> keysPtrs = {
-        keys[0].data(), keys[1].data(), keys[2].data()
+    std::array<const void*, 4> keysPtrs = {
+        keys[0].data(), keys[1].data(), keys[2].data(), keys[3].data()
     };
-    std::array<size_t, 3> ksizes = {
-        keys[0].size(), keys[1].size(), keys[2].size()
+    std::array<size_t, 4> ksizes = {
+        keys[0].size(), keys[1].size(), keys[2].size(), keys[3].size()
     };
-    std::array<size_t, 3> vsizes = {0, 0, 0};
+    std::array<size_t, 4> vsizes = {0, 0, 0, 0};
     // get the length of these keys. These keys are never overwritten
     // so the length is not going to change by the time we call getMulti.
     try {
-        spdlog::trace("[mofka:client] Checking key lengths for validator, selector, and serializer");
-        m_yk_master_db.lengthMulti(3,
+        spdlog::trace("[mofka:client] Checking key lengths for validator, selector, serializer, and compression");
+        m_yk_master_db.lengthMulti(4,
             keysPtrs.data(), ksizes.data(), vsizes.data(), YOKAN_MODE_NO_RDMA);
     } catch(const yokan::Exception& ex) {
         spdlog::trace("[mofka:client] Yokan lengthMulti failed: {}", ex.what());
@@ -348,8 +364,8 @@ std::shared_ptr<diaspora::TopicHandleInterface> MofkaDriver::openTopic(std::stri
             "Unexpected error from lengthMulti: {}",
             name, ex.what())};
     }
-    // if any of the keys is not found, this is a problem
-    for(size_t i = 0; i < vsizes.size(); ++i) {
+    // if any of the first 3 keys is not found, this is a problem
+    for(size_t i = 0; i < 3; ++i) {
         if(vsizes[i] == YOKAN_KEY_NOT_FOUND) {
             spdlog::trace("[mofka:client] Key \"{}\" not found in master database", keys[i]);
             throw diaspora::Exception{
@@ -359,17 +375,19 @@ std::shared_ptr<diaspora::TopicHandleInterface> MofkaDriver::openTopic(std::stri
         }
     }
 
+    const size_t num_keys = vsizes[3] == YOKAN_KEY_NOT_FOUND ? 3 : 4;
+
     // get the values for the keys
-    std::array<std::string, 3> values;
-    for(size_t i = 0; i < 3; ++i) {
+    std::array<std::string, 4> values;
+    for(size_t i = 0; i < num_keys; ++i) {
         values[i].resize(vsizes[i]);
     }
-    std::array<void*, 3> valuesPtrs = {
-        values[0].data(), values[1].data(), values[2].data()
+    std::array<void*, 4> valuesPtrs = {
+        values[0].data(), values[1].data(), values[2].data(), values[3].data()
     };
     try {
-        spdlog::trace("[mofka:client] Getting validator, selector, and serializer from master database");
-        m_yk_master_db.getMulti(3,
+        spdlog::trace("[mofka:client] Getting validator, selector, serializer, and compression from master database");
+        m_yk_master_db.getMulti(num_keys,
             keysPtrs.data(), ksizes.data(),
             valuesPtrs.data(), vsizes.data(), YOKAN_MODE_NO_RDMA);
     } catch(const yokan::Exception& ex) {
@@ -393,6 +411,9 @@ std::shared_ptr<diaspora::TopicHandleInterface> MofkaDriver::openTopic(std::stri
     auto selector = diaspora::PartitionSelector::FromMetadata(diaspora::Metadata{values[1]});
     spdlog::trace("[mofka:client] Instantiating serializer");
     auto serializer = diaspora::Serializer::FromMetadata(diaspora::Metadata{values[2]});
+    CompressionConfig compression;
+    if(num_keys == 4)
+        compression = CompressionConfig::FromMetadata(diaspora::Metadata{values[3]});
 
     // create a Collection object to access the collection of partitions
     spdlog::trace("[mofka:client] opening collection of partitions");
@@ -455,7 +476,8 @@ std::shared_ptr<diaspora::TopicHandleInterface> MofkaDriver::openTopic(std::stri
         std::move(selector),
         std::move(serializer),
         std::move(partitionsList),
-        const_cast<MofkaDriver*>(this)->shared_from_this());
+        const_cast<MofkaDriver*>(this)->shared_from_this(),
+        compression);
 }
 
 std::unordered_map<std::string, diaspora::Metadata> MofkaDriver::listTopics() const {
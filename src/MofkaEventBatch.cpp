@@ -0,0 +1,60 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "ConsumerBatchImpl.hpp"
+
+#include <mofka/MofkaEventBatch.hpp>
+#include <mofka/MofkaEvent.hpp>
+
+#include <diaspora/Exception.hpp>
+
+using namespace std::string_literals;
+
+namespace mofka {
+
+diaspora::EventID MofkaEventBatch::firstID() const {
+    if(!m_batch) return diaspora::NoMoreEvents;
+    return m_batch->m_first_id + m_begin;
+}
+
+const diaspora::Metadata& MofkaEventBatch::metadata(size_t i) const {
+    if(i >= size())
+        throw diaspora::Exception{"Invalid index passed to MofkaEventBatch::metadata"};
+    return m_batch->metadata(m_begin + i);
+}
+
+const diaspora::DataView& MofkaEventBatch::data(size_t i) const {
+    if(i >= size())
+        throw diaspora::Exception{"Invalid index passed to MofkaEventBatch::data"};
+    auto& result = m_batch->m_data[m_begin + i];
+    if(!result.success())
+        throw diaspora::Exception{result.error()};
+    return result.value();
+}
+
+diaspora::PartitionInfo MofkaEventBatch::partition() const {
+    if(!m_batch || !m_batch->m_partition)
+        return diaspora::PartitionInfo{};
+    return m_batch->m_partition->toPartitionInfo();
+}
+
+diaspora::Event MofkaEventBatch::event(size_t i) const {
+    if(i >= size())
+        throw diaspora::Exception{"Invalid index passed to MofkaEventBatch::event"};
+    return diaspora::Event{ConsumerBatchImpl::MakeEvent(m_batch, m_begin + i, data(i))};
+}
+
+void MofkaEventBatch::acknowledge() const {
+    if(empty())
+        throw diaspora::Exception{"Cannot acknowledge an empty MofkaEventBatch"};
+    try {
+        auto ph = m_batch->m_partition->m_ph;
+        (*m_batch->m_ack_rpc).on(ph)(m_batch->m_consumer_name, id(size()-1));
+    } catch(const std::exception& ex) {
+        throw diaspora::Exception{"Could not acknowledge event: "s + ex.what()};
+    }
+}
+
+}
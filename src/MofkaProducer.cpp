@@ -14,6 +14,7 @@
 #include <diaspora/Exception.hpp>
 #include <diaspora/TopicHandle.hpp>
 #include <diaspora/Future.hpp>
+#include <diaspora/BufferWrapperArchive.hpp>
 
 #include <thallium/serialization/stl/string.hpp>
 #include <thallium/serialization/stl/pair.hpp>
@@ -29,7 +30,11 @@ MofkaProducer::MofkaProducer(
         diaspora::Ordering ordering,
         std::shared_ptr<MofkaThreadPool> thread_pool,
         std::shared_ptr<MofkaTopicHandle> topic,
-        bool ack_early)
+        bool ack_early,
+        bool serialize_on_push,
+        size_t batch_max_bytes,
+        std::chrono::microseconds batch_linger,
+        size_t small_event_threshold)
 : m_engine{std::move(engine)}
 , m_name{name}
 , m_batch_size{batch_size}
@@ -39,8 +44,13 @@ MofkaProducer::MofkaProducer(
 , m_topic(std::move(topic))
 , m_producer_send_batch(m_engine.define("mofka_producer_send_batch"))
 , m_ack_early{ack_early}
+, m_serialize_on_push{serialize_on_push}
+, m_batch_max_bytes{batch_max_bytes}
+, m_batch_linger{batch_linger}
+, m_small_event_threshold{small_event_threshold}
 {
     m_batch_queues.resize(m_topic->partitions().size());
+    m_batch_queue_ptrs = std::vector<std::atomic<ActiveProducerBatchQueue*>>(m_batch_queues.size());
 }
 
 MofkaProducer::~MofkaProducer() {
@@ -55,6 +65,23 @@ diaspora::Future<std::optional<diaspora::EventID>> MofkaProducer::push(
         diaspora::Metadata metadata,
         diaspora::DataView data,
         std::optional<size_t> partition) {
+    return *pushWithDeadline(metadata, data, partition, std::nullopt);
+}
+
+std::optional<diaspora::Future<std::optional<diaspora::EventID>>> MofkaProducer::tryPush(
+        diaspora::Metadata& metadata,
+        diaspora::DataView& data,
+        std::optional<size_t> partition,
+        std::chrono::microseconds timeout) {
+    return pushWithDeadline(metadata, data, partition,
+                            std::chrono::steady_clock::now() + timeout);
+}
+
+std::optional<diaspora::Future<std::optional<diaspora::EventID>>> MofkaProducer::pushWithDeadline(
+        diaspora::Metadata& metadata,
+        diaspora::DataView& data,
+        std::optional<size_t> partition,
+        std::optional<std::chrono::steady_clock::time_point> deadline) {
     /* Step 1: create a future/promise pair for this operation */
     diaspora::Future<std::optional<diaspora::EventID>> future;
     Promise<std::optional<diaspora::EventID>> promise;
@@ -70,33 +97,72 @@ diaspora::Future<std::optional<diaspora::EventID>> MofkaProducer::push(
     /* Select the partition for this metadata */
     auto partition_index = m_topic->selector().selectPartitionFor(metadata, partition);
     /* Find/create the ActiveProducerBatchQueue to send to */
-    std::shared_ptr<ActiveProducerBatchQueue> queue;
-    {
-        std::unique_lock<thallium::mutex> guard{m_batch_queues_mtx};
-        if(m_batch_queues[partition_index]) {
-            queue = m_batch_queues[partition_index];
-        } else {
-            auto create_new_batch = [this, partition_index]() {
-                auto& partition = m_topic->m_partitions.at(partition_index);
-                return std::make_shared<ProducerBatch>(
-                            m_name, m_engine,
-                            m_topic->m_serializer,
-                            partition->m_ph,
-                            m_producer_send_batch,
-                            m_ack_early);
-            };
-            queue = std::make_shared<ActiveProducerBatchQueue>(
-                    std::move(create_new_batch),
-                    m_thread_pool,
-                    m_batch_size,
-                    m_max_batch);
-            m_batch_queues[partition_index] = queue;
-        }
+    auto queue = getQueue(partition_index);
+    bool pushed;
+    if(m_serialize_on_push) {
+        /* Serialize the metadata on the caller's thread before enqueuing
+         * it; the batch then only holds the serialized bytes */
+        std::vector<char> serialized_metadata;
+        diaspora::BufferWrapperOutputArchive archive(serialized_metadata);
+        m_topic->m_serializer.serialize(archive, metadata);
+        pushed = queue->push(std::move(serialized_metadata), data, promise, deadline);
+    } else {
+        pushed = queue->push(metadata, data, promise, deadline);
     }
-    queue->push(std::move(metadata), std::move(data), promise);
+    if(!pushed) return std::nullopt;
+    m_num_pushed_events.fetch_add(1, std::memory_order_relaxed);
     return future;
 }
 
+ActiveProducerBatchQueue* MofkaProducer::getQueue(size_t partition_index) {
+    auto queue = m_batch_queue_ptrs[partition_index].load(std::memory_order_acquire);
+    if(queue) return queue;
+    std::unique_lock<thallium::mutex> guard{m_batch_queues_mtx};
+    if(!m_batch_queues[partition_index]) {
+        auto load_stats = PartitionLoadStats::ForPartition(
+            m_topic->m_partitions.at(partition_index)->m_uuid.to_string());
+        auto create_new_batch = [this, partition_index, load_stats]() {
+            auto& partition = m_topic->m_partitions.at(partition_index);
+            return std::make_shared<ProducerBatch>(
+                        m_name, m_engine,
+                        m_topic->m_serializer,
+                        partition->m_ph,
+                        m_producer_send_batch,
+                        m_ack_early,
+                        m_serialize_on_push,
+                        m_batch_size == diaspora::BatchSize::Adaptive() ? 0 : m_batch_size.value,
+                        m_small_event_threshold,
+                        m_topic->m_compression,
+                        load_stats);
+        };
+        m_batch_queues[partition_index] = std::make_shared<ActiveProducerBatchQueue>(
+                std::move(create_new_batch),
+                m_thread_pool,
+                m_batch_size,
+                m_max_batch,
+                // strict ordering requires the batches to reach the
+                // partition in the order they were filled
+                m_ordering == diaspora::Ordering::Strict ? 1 : m_max_batch.value,
+                ActiveProducerBatchQueue::BatchingPolicy{m_batch_max_bytes, m_batch_linger});
+    }
+    queue = m_batch_queues[partition_index].get();
+    m_batch_queue_ptrs[partition_index].store(queue, std::memory_order_release);
+    return queue;
+}
+
+MofkaProducer::Stats MofkaProducer::stats() const {
+    Stats stats;
+    stats.pushed_events = m_num_pushed_events.load(std::memory_order_relaxed);
+    for(auto& ptr : m_batch_queue_ptrs) {
+        auto queue = ptr.load(std::memory_order_acquire);
+        if(!queue) continue;
+        stats.queued_events     += queue->queuedEvents();
+        stats.queued_bytes      += queue->queuedBytes();
+        stats.in_flight_batches += queue->inFlightBatches();
+    }
+    return stats;
+}
+
 diaspora::Future<std::optional<diaspora::Flushed>> MofkaProducer::flush() {
     std::lock_guard<thallium::mutex> guard{m_batch_queues_mtx};
     std::shared_ptr<
@@ -25,16 +25,29 @@ std::shared_ptr<diaspora::ProducerInterface> MofkaTopicHandle::makeProducer(
         diaspora::Ordering ordering,
         std::shared_ptr<diaspora::ThreadPoolInterface> thread_pool,
         diaspora::Metadata options) {
-    (void)options;
     if(!thread_pool) thread_pool = m_driver->defaultThreadPool();
+    if(!CompressionConfig::IsAvailable(m_compression.codec))
+        throw diaspora::Exception{fmt::format(
+            "Topic \"{}\" uses a compression codec that is not available in this build",
+            m_name)};
     bool ack_early = options.json().contains("ack_early")
                   && options.json()["ack_early"].get<bool>();
+    bool serialize_on_push = options.json().contains("serialize_on_push")
+                          && options.json()["serialize_on_push"].get<bool>();
+    size_t batch_max_bytes = options.json().contains("batch_max_bytes")
+                           ? options.json()["batch_max_bytes"].get<size_t>() : 0;
+    auto batch_linger = std::chrono::microseconds{
+        options.json().contains("batch_linger_us")
+        ? options.json()["batch_linger_us"].get<int64_t>() : 0};
+    size_t small_event_threshold = options.json().contains("small_event_threshold")
+                                 ? options.json()["small_event_threshold"].get<size_t>() : 0;
     auto mofka_thread_pool = std::dynamic_pointer_cast<MofkaThreadPool>(thread_pool);
     if(!mofka_thread_pool)
         throw diaspora::Exception{"ThreadPool should be an instance of MofkaThreadPool"};
     return std::make_shared<MofkaProducer>(
         m_engine, name, batch_size, max_batch, ordering, std::move(mofka_thread_pool),
-        shared_from_this(), ack_early);
+        shared_from_this(), ack_early, serialize_on_push,
+        batch_max_bytes, batch_linger, small_event_threshold);
 }
 
 std::shared_ptr<diaspora::ConsumerInterface> MofkaTopicHandle::makeConsumer(
@@ -46,7 +59,6 @@ std::shared_ptr<diaspora::ConsumerInterface> MofkaTopicHandle::makeConsumer(
         diaspora::DataSelector data_selector,
         const std::vector<size_t>& targets,
         diaspora::Metadata options) {
-    (void)options;
     if(!thread_pool) thread_pool = m_driver->defaultThreadPool();
     auto mofka_thread_pool = std::dynamic_pointer_cast<MofkaThreadPool>(thread_pool);
     if(!mofka_thread_pool)
@@ -63,11 +75,52 @@ std::shared_ptr<diaspora::ConsumerInterface> MofkaTopicHandle::makeConsumer(
             partitions.push_back(m_partitions[partition_index]);
         }
     }
+    const auto& opts = options.json();
+    size_t data_request_max_events = 64;
+    size_t data_prefetch_window = 4;
+    size_t process_max_concurrency = 16;
+    bool process_ordered = false;
+    bool pull_batches = false;
+    size_t recv_pool_num_tiers     = 1;
+    size_t recv_pool_num_buffers   = 0;
+    size_t recv_pool_first_size    = 64*1024;
+    float  recv_pool_size_multiple = 4.0f;
+    if(opts.is_object()) {
+        if(opts.contains("data_request_max_events"))
+            data_request_max_events = opts["data_request_max_events"].get<size_t>();
+        if(opts.contains("data_prefetch_window"))
+            data_prefetch_window = opts["data_prefetch_window"].get<size_t>();
+        if(opts.contains("process_max_concurrency"))
+            process_max_concurrency = opts["process_max_concurrency"].get<size_t>();
+        if(opts.contains("process_ordered"))
+            process_ordered = opts["process_ordered"].get<bool>();
+        if(opts.contains("pull_batches"))
+            pull_batches = opts["pull_batches"].get<bool>();
+        if(opts.contains("recv_buffer_pool") && opts["recv_buffer_pool"].is_object()) {
+            const auto& pool = opts["recv_buffer_pool"];
+            recv_pool_num_tiers     = pool.value("num_tiers",     recv_pool_num_tiers);
+            recv_pool_num_buffers   = pool.value("num_buffers",   recv_pool_num_buffers);
+            recv_pool_first_size    = pool.value("first_size",    recv_pool_first_size);
+            recv_pool_size_multiple = pool.value("size_multiple", recv_pool_size_multiple);
+        }
+    }
     auto consumer = std::make_shared<MofkaConsumer>(
             m_engine, name, batch_size, max_batch,
             std::move(mofka_thread_pool), data_allocator, data_selector,
             shared_from_this(),
-            std::move(partitions));
+            std::move(partitions),
+            data_request_max_events,
+            data_prefetch_window,
+            process_max_concurrency,
+            process_ordered,
+            pull_batches,
+            std::make_shared<thallium::bulk_buffer_pool<>>(
+                m_engine,
+                std::max<size_t>(recv_pool_num_tiers, 1),
+                recv_pool_num_buffers,
+                std::max<size_t>(recv_pool_first_size, 1),
+                std::max(recv_pool_size_multiple, 1.0f),
+                thallium::bulk_mode::write_only));
     consumer->subscribe();
     return consumer;
 }
@@ -0,0 +1,90 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_PARTITION_LOAD_H
+#define MOFKA_PARTITION_LOAD_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mofka {
+
+/**
+ * @brief Load signal sent back by a partition along with the response
+ * to a batch: number of batches received but not yet stored, and the
+ * number of bytes they hold.
+ */
+struct PartitionLoad {
+
+    uint64_t queue_depth   = 0;
+    uint64_t pending_bytes = 0;
+
+    template<typename Archive>
+    void serialize(Archive& ar) {
+        ar(queue_depth, pending_bytes);
+    }
+};
+
+/**
+ * @brief Most recent load signal and smoothed RPC latency observed by
+ * the producers of this process for a given partition. The fields are
+ * atomics so that producer batches can update them and selectors can
+ * read them without locking.
+ */
+class PartitionLoadStats {
+
+    public:
+
+    std::atomic<uint64_t> queue_depth    = 0;
+    std::atomic<uint64_t> pending_bytes  = 0;
+    std::atomic<uint64_t> latency_us     = 0; /* exponential moving average */
+    std::atomic<int64_t>  last_update_us = 0; /* steady_clock, 0 if never updated */
+
+    /**
+     * @brief Records the load returned by a partition and the latency
+     * of the RPC that returned it.
+     */
+    void update(const PartitionLoad& load, std::chrono::microseconds latency) {
+        queue_depth.store(load.queue_depth, std::memory_order_relaxed);
+        pending_bytes.store(load.pending_bytes, std::memory_order_relaxed);
+        // racing updates may lose a sample, which is fine for an average
+        uint64_t sample = latency.count() > 0 ? latency.count() : 0;
+        uint64_t avg    = latency_us.load(std::memory_order_relaxed);
+        latency_us.store(avg == 0 ? sample : (avg*7 + sample)/8, std::memory_order_relaxed);
+        last_update_us.store(Now().count(), std::memory_order_relaxed);
+    }
+
+    static std::chrono::microseconds Now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch());
+    }
+
+    /**
+     * @brief Returns the statistics of the partition with the given UUID,
+     * shared by all the producers and selectors of this process.
+     * This should only be called when setting up producers and selectors.
+     */
+    static std::shared_ptr<PartitionLoadStats> ForPartition(const std::string& uuid) {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::weak_ptr<PartitionLoadStats>> registry;
+        auto g = std::unique_lock<std::mutex>{mutex};
+        auto& entry = registry[uuid];
+        auto stats = entry.lock();
+        if(!stats) {
+            stats = std::make_shared<PartitionLoadStats>();
+            entry = stats;
+        }
+        return stats;
+    }
+};
+
+}
+
+#endif
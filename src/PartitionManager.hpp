@@ -8,8 +8,10 @@
 
 #include "Result.hpp"
 #include "ConsumerHandle.hpp"
+#include "PartitionLoad.hpp"
 
 #include <mofka/UUID.hpp>
+#include <mofka/Compression.hpp>
 
 #include <diaspora/ForwardDcl.hpp>
 #include <diaspora/Metadata.hpp>
@@ -17,10 +19,15 @@
 #include <diaspora/BatchParams.hpp>
 #include <diaspora/EventID.hpp>
 #include <diaspora/Factory.hpp>
+#include <diaspora/Exception.hpp>
 
 #include <bedrock/AbstractComponent.hpp>
 
 #include <thallium.hpp>
+#include <fmt/format.h>
+#include <numeric>
+#include <span>
+#include <vector>
 #include <unordered_map>
 #include <string_view>
 #include <functional>
@@ -72,6 +79,8 @@ class PartitionManager {
      *
      * @param producer_name Name of the producer.
      * @param num_events Number of events sent.
+     * @param metadata_codec Codec with which the producer compressed the
+     * metadata content as a single block (CompressionCodec::None if it did not).
      * @param metadata_bulk_size Total size of the bulk handle holding metadata and sizes.
      * @param metadata_bulk_offset Offset at which to start in the bulk handle.
      * @param metadata_bulk Bulk handle holding metadata sizes and metadata.
@@ -83,6 +92,9 @@ class PartitionManager {
      * as follows. If N is the number of events, then:
      * - the first N*sizeof(size_t) bytes contain metadata/data sizes;
      * - the next S bytes (sum of the above sizes) contain the metadata/data content.
+     * If metadata_codec is not CompressionCodec::None, the metadata content is
+     * instead a block produced by CompressAppend, which the implementation
+     * should decompress (see DecompressMetadata) before storing it.
      *
      * @return a Result containing the result.
      */
@@ -90,9 +102,46 @@ class PartitionManager {
         const thallium::request& req,
         const std::string& producer_name,
         size_t num_events,
+        CompressionCodec metadata_codec,
         const BulkRef& metadata_bulk,
         const BulkRef& data_bulk) = 0;
 
+    /**
+     * @brief Whether this PartitionManager can acknowledge a batch before
+     * it is durably stored (see receiveBatchAckEarly).
+     */
+    virtual bool supportsAckEarly() const { return false; }
+
+    /**
+     * @brief Same as receiveBatch, but the PartitionManager may respond
+     * to the request as soon as the batch has been transferred into its
+     * memory, and store it in the background. Used when the producer
+     * requested early acknowledgment.
+     *
+     * The default implementation falls back to receiveBatch.
+     */
+    virtual void receiveBatchAckEarly(
+        const thallium::request& req,
+        const std::string& producer_name,
+        size_t num_events,
+        CompressionCodec metadata_codec,
+        const BulkRef& metadata_bulk,
+        const BulkRef& data_bulk) {
+        receiveBatch(req, producer_name, num_events, metadata_codec, metadata_bulk, data_bulk);
+    }
+
+    /**
+     * @brief Returns the current load of the partition. This is sent back
+     * to producers along with the response to receiveBatch, so an
+     * implementation's receiveBatch should respond with
+     * req.respond(result, load()).
+     *
+     * The default implementation reports no load.
+     */
+    virtual PartitionLoad load() const {
+        return PartitionLoad{};
+    }
+
     /**
      * @brief This function is used to wake up the topic manager to make
      * if check again the shouldStop() function of blocked ConsumerHandles.
@@ -156,6 +205,27 @@ class PartitionManager {
         return diaspora::Metadata{nlohmann::json::object()};
     }
 
+    protected:
+
+    /**
+     * @brief Decompresses into output the metadata content of a batch
+     * received with a metadata_codec other than CompressionCodec::None.
+     * Throws a diaspora::Exception if the block is invalid or if it does
+     * not decompress to as many bytes as the metadata sizes add up to.
+     */
+    static void DecompressMetadata(CompressionCodec metadata_codec,
+                                   std::span<const size_t> metadata_sizes,
+                                   const char* content, size_t content_size,
+                                   std::vector<char>& output) {
+        Decompress(metadata_codec, content, content_size, output);
+        auto expected_size = std::accumulate(
+            metadata_sizes.begin(), metadata_sizes.end(), (size_t)0);
+        if(output.size() != expected_size)
+            throw diaspora::Exception{fmt::format(
+                "Decompressed metadata has {} bytes, expected {}",
+                output.size(), expected_size)};
+    }
+
 };
 
 template <typename ManagerType>
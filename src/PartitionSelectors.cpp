@@ -0,0 +1,16 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "KeyHashPartitionSelector.hpp"
+#include "StickyPartitionSelector.hpp"
+#include "LoadAwarePartitionSelector.hpp"
+
+namespace mofka {
+
+DIASPORA_REGISTER_PARTITION_SELECTOR(mofka, key_hash, KeyHashPartitionSelector);
+DIASPORA_REGISTER_PARTITION_SELECTOR(mofka, sticky, StickyPartitionSelector);
+DIASPORA_REGISTER_PARTITION_SELECTOR(mofka, load_aware, LoadAwarePartitionSelector);
+
+}
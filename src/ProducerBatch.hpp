@@ -7,11 +7,13 @@
 #define MOFKA_PRODUCER_BATCH_H
 
 #include "Result.hpp"
+#include "PartitionLoad.hpp"
 
 #include <mofka/MofkaPartitionInfo.hpp>
 #include <mofka/MofkaProducer.hpp>
 #include <mofka/Promise.hpp>
 #include <mofka/BulkRef.hpp>
+#include <mofka/Compression.hpp>
 
 #include <diaspora/EventID.hpp>
 #include <diaspora/Metadata.hpp>
@@ -25,9 +27,13 @@
 #include <thallium.hpp>
 #include <fmt/format.h>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <vector>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 
 namespace mofka {
 
@@ -35,10 +41,13 @@ namespace tl = thallium;
 
 class ProducerBatch {
 
+    static constexpr size_t NOT_IN_ARENA = std::numeric_limits<size_t>::max();
+
     struct Entry {
         diaspora::Metadata                        metadata;
         diaspora::DataView                        data;
         Promise<std::optional<diaspora::EventID>> promise;
+        size_t                                    arena_offset = NOT_IN_ARENA;
     };
 
     std::string                m_producer_name;
@@ -47,16 +56,54 @@ class ProducerBatch {
     thallium::provider_handle  m_partition_ph;
     thallium::remote_procedure m_send_batch_rpc;
     bool                       m_ack_early = false;
+    bool                       m_serialized_on_push = false;
+    size_t                     m_small_event_threshold = 0;
+    CompressionConfig          m_compression;
 
     std::vector<Entry> m_entries;
+    size_t             m_byte_size = 0;
+    std::chrono::steady_clock::time_point m_first_push_time;
 
-    /* buffers for serialization and sending */
+    /* buffers for serialization and sending; m_meta_buffer holds the
+     * metadata sizes followed by the serialized metadata, and keeps its
+     * capacity (and hence its RDMA registration) when the batch is reused */
     std::vector<size_t>                   m_meta_sizes;
     std::vector<char>                     m_meta_buffer;
     std::vector<size_t>                   m_data_sizes;
     std::vector<std::pair<void*, size_t>> m_data_segments;
+    std::string                           m_self_addr;
+
+    /* with m_compression enabled, the metadata of all the entries is
+     * compressed as a single block into m_compression_scratch, which
+     * then replaces it in m_meta_buffer */
+    std::vector<char>                     m_compression_scratch;
+
+    /* with m_serialized_on_push, the metadata is appended to m_meta_buffer
+     * after m_meta_header_reserved bytes kept for the sizes, which are
+     * written right before the metadata when the batch is sent */
+    size_t         m_meta_header_reserved = 0;
 
     thallium::bulk m_meta_bulk;
+    const char*    m_meta_bulk_ptr = nullptr;
+    size_t         m_meta_bulk_capacity = 0;
+    thallium::bulk m_data_bulk;
+
+    /* with m_small_event_threshold, the data of events up to that size is
+     * copied into m_data_arena after m_data_header_reserved bytes kept for
+     * the data sizes; like m_meta_buffer, the arena keeps its registration
+     * when the batch is reused */
+    std::vector<char> m_data_arena;
+    size_t            m_data_header_reserved = 0;
+    thallium::bulk    m_arena_bulk;
+    const char*       m_arena_bulk_ptr = nullptr;
+    size_t            m_arena_bulk_capacity = 0;
+
+    /* response of the RPC issued by start(), and when it was issued */
+    std::optional<thallium::async_response> m_response;
+    std::chrono::steady_clock::time_point   m_send_time;
+
+    /* statistics updated with the load returned by the partition */
+    std::shared_ptr<PartitionLoadStats>     m_load_stats;
 
     public:
 
@@ -66,50 +113,118 @@ class ProducerBatch {
         diaspora::Serializer serializer,
         thallium::provider_handle partition_ph,
         thallium::remote_procedure send_batch,
-        bool ack_early = false)
+        bool ack_early = false,
+        bool serialize_on_push = false,
+        size_t expected_count = 0,
+        size_t small_event_threshold = 0,
+        CompressionConfig compression = {},
+        std::shared_ptr<PartitionLoadStats> load_stats = nullptr)
     : m_producer_name{std::move(producer_name)}
     , m_engine{std::move(engine)}
     , m_serializer{std::move(serializer)}
     , m_partition_ph{std::move(partition_ph)}
     , m_send_batch_rpc{std::move(send_batch)}
     , m_ack_early{ack_early}
-    {}
+    , m_serialized_on_push{serialize_on_push}
+    , m_small_event_threshold{small_event_threshold}
+    , m_compression{compression}
+    , m_self_addr{static_cast<std::string>(m_engine.self())}
+    , m_load_stats{std::move(load_stats)}
+    {
+        if(m_serialized_on_push)
+            m_meta_header_reserved = expected_count*sizeof(size_t);
+        if(m_small_event_threshold)
+            m_data_header_reserved = expected_count*sizeof(size_t);
+    }
 
     void push(diaspora::Metadata metadata,
               diaspora::DataView data,
               Promise<std::optional<diaspora::EventID>> promise) {
-        m_entries.push_back({std::move(metadata), std::move(data), std::move(promise)});
+        if(m_entries.empty())
+            m_first_push_time = std::chrono::steady_clock::now();
+        m_byte_size += data.size();
+        addEntry(std::move(metadata), std::move(data), std::move(promise));
+    }
+
+    /**
+     * @brief Pushes an event whose metadata has already been serialized.
+     * Only valid if the batch was created with serialize_on_push.
+     */
+    void push(const std::vector<char>& serialized_metadata,
+              diaspora::DataView data,
+              Promise<std::optional<diaspora::EventID>> promise) {
+        if(m_entries.empty()) {
+            m_first_push_time = std::chrono::steady_clock::now();
+            m_meta_buffer.resize(m_meta_header_reserved);
+        }
+        m_byte_size += serialized_metadata.size() + data.size();
+        m_meta_buffer.insert(m_meta_buffer.end(),
+                             serialized_metadata.begin(),
+                             serialized_metadata.end());
+        m_meta_sizes.push_back(serialized_metadata.size());
+        addEntry(diaspora::Metadata{}, std::move(data), std::move(promise));
     }
 
+    /**
+     * @brief Sends the batch and waits for the response,
+     * equivalent to start() followed by complete().
+     */
     void send() {
-        m_meta_sizes.reserve(count());
-        bool first_entry = true;
-        diaspora::BufferWrapperOutputArchive archive(m_meta_buffer);
+        start();
+        complete();
+    }
+
+    /**
+     * @brief Serializes the batch, exposes it for RDMA, and issues the
+     * mofka_producer_send_batch RPC without waiting for its response.
+     * The batch must not be modified until complete() has been called.
+     */
+    void start() {
+        const size_t meta_offset = m_serialized_on_push
+                                 ? writeMetadataHeader()
+                                 : serializeMetadata();
+        const auto metadata_codec = compressMetadata(meta_offset);
+        bool all_in_arena = m_small_event_threshold != 0;
         m_data_segments.emplace_back(); // first entry changed later
         for(auto& entry : m_entries) {
-            size_t meta_buffer_size = m_meta_buffer.size();
-            m_serializer.serialize(archive, entry.metadata);
-            size_t meta_size = m_meta_buffer.size() - meta_buffer_size;
-            if(first_entry) {
-                // use the first entry metadata size as an estimate for the total size
-                size_t estimated_total_size = meta_size * m_entries.size() * 1.1;
-                m_meta_buffer.reserve(estimated_total_size);
-                first_entry = false;
+            if(entry.arena_offset != NOT_IN_ARENA) {
+                const auto size = entry.data.size();
+                auto ptr = m_data_arena.data() + entry.arena_offset;
+                auto& last = m_data_segments.back();
+                if(m_data_segments.size() > 1 && (char*)last.first + last.second == ptr)
+                    last.second += size; // extends the previous arena range
+                else
+                    m_data_segments.emplace_back(ptr, size);
+                m_data_sizes.push_back(size);
+                continue;
             }
-            m_meta_sizes.push_back(meta_size);
             size_t data_size = 0;
             for(const auto& seg : entry.data.segments()) {
                 if(seg.size == 0) continue;
                 m_data_segments.emplace_back(seg.ptr, seg.size);
                 data_size += seg.size;
             }
+            if(data_size != 0) all_in_arena = false;
             m_data_sizes.push_back(data_size);
         }
+        // a batch of events that all have empty data has nothing in the
+        // arena to hold the sizes header, so it uses the segments instead
+        all_in_arena = all_in_arena && !m_data_arena.empty();
         m_data_segments[0] = {m_data_sizes.data(), m_data_sizes.size()*sizeof(m_data_sizes[0])};
-        thallium::bulk data_bulk;
+        size_t data_offset = 0;
+        size_t data_size   = 0;
         try {
             exposeMetadata();
-            data_bulk = exposeData(m_data_segments);
+            if(all_in_arena) {
+                // the sizes and data form one contiguous, pre-registered region
+                data_offset = writeSizesHeader(m_data_arena, m_data_header_reserved, m_data_sizes);
+                exposeArena();
+                m_data_bulk = m_arena_bulk;
+                data_size   = m_data_arena.size() - data_offset;
+            } else {
+                m_data_bulk = exposeData(m_data_segments);
+                data_size   = m_data_bulk.size();
+            }
         } catch(const std::exception& ex) {
             setPromises(
                 diaspora::Exception{fmt::format(
@@ -117,25 +232,52 @@ class ProducerBatch {
             return;
         }
         try {
-            auto self_addr = static_cast<std::string>(m_engine.self());
-            Result<diaspora::EventID> result = m_send_batch_rpc.on(m_partition_ph)(
+            m_send_time = std::chrono::steady_clock::now();
+            m_response = m_send_batch_rpc.on(m_partition_ph).async(
                 m_producer_name, count(), m_ack_early,
-                BulkRef{m_meta_bulk, 0, m_meta_bulk.size(), self_addr},
-                BulkRef{data_bulk, 0, data_bulk.size(), self_addr});
-            if(result.success()) {
-                setPromises(result.value());
-            } else {
-                setPromises(diaspora::Exception{result.error()});
-            }
+                static_cast<uint8_t>(metadata_codec),
+                BulkRef{m_meta_bulk, meta_offset, m_meta_buffer.size() - meta_offset, m_self_addr},
+                BulkRef{m_data_bulk, data_offset, data_size, m_self_addr});
         } catch(const std::exception& ex) {
             setPromises(
                 diaspora::Exception{fmt::format(
                     "Unexpected error when sending batch: {}", ex.what())});
         }
+    }
 
+    /**
+     * @brief Waits for the response of the RPC issued by start(), sets the
+     * promises of the batch's events accordingly, and clears the batch.
+     */
+    void complete() {
+        if(m_response) {
+            try {
+                auto [result, load] = m_response->wait()
+                    .as<Result<diaspora::EventID>, PartitionLoad>();
+                if(m_load_stats) {
+                    m_load_stats->update(load,
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - m_send_time));
+                }
+                if(result.success()) {
+                    setPromises(result.value());
+                } else {
+                    setPromises(diaspora::Exception{result.error()});
+                }
+            } catch(const std::exception& ex) {
+                setPromises(
+                    diaspora::Exception{fmt::format(
+                        "Unexpected error when sending batch: {}", ex.what())});
+            }
+            m_response.reset();
+        }
+
+        m_data_bulk = thallium::bulk{};
         m_entries.clear();
+        m_byte_size = 0;
         m_meta_sizes.clear();
         m_meta_buffer.clear();
+        m_data_arena.clear();
         m_data_sizes.clear();
         m_data_segments.clear();
     }
@@ -144,6 +286,21 @@ class ProducerBatch {
         return m_entries.size();
     }
 
+    /**
+     * @brief Number of bytes of data in the batch, plus the metadata
+     * bytes if the metadata is serialized when pushed.
+     */
+    size_t byteSize() const {
+        return m_byte_size;
+    }
+
+    /**
+     * @brief Time at which the first entry was pushed into the batch.
+     */
+    std::chrono::steady_clock::time_point firstPushTime() const {
+        return m_first_push_time;
+    }
+
     private:
 
     void setPromises(diaspora::EventID firstID) {
@@ -160,38 +317,128 @@ class ProducerBatch {
         }
     }
 
-    void exposeMetadata() {
-        /* first check if we actually need to change the existing bulk */
-        auto seg_count = m_meta_bulk.segment_count();
-        if(seg_count == 2) {
-            auto bulk = m_meta_bulk.get_bulk();
-            void* ptrs[2];
-            hg_size_t sizes[2];
-            hg_uint32_t actual_count;
-            hg_return_t ret = margo_bulk_access(
-                bulk, 0, m_meta_bulk.size(), HG_BULK_READ_ONLY, 2,
-                ptrs, sizes, &actual_count);
-            if(ret == HG_SUCCESS
-            && ptrs[0] == (void*)m_meta_sizes.data()
-            && sizes[0] == m_meta_sizes.size()*sizeof(m_meta_sizes[0])
-            && ptrs[1] == (void*)m_meta_buffer.data()
-            && sizes[1] == m_meta_buffer.size()*sizeof(m_meta_buffer[0])) {
-                return;
+    /* Serializes the metadata of all the entries after a header holding
+     * their sizes. Returns the offset of the header in m_meta_buffer.
+     */
+    size_t serializeMetadata() {
+        m_meta_sizes.reserve(count());
+        const size_t header_size = count()*sizeof(size_t);
+        m_meta_buffer.resize(header_size); // filled with the sizes below
+        bool first_entry = true;
+        diaspora::BufferWrapperOutputArchive archive(m_meta_buffer);
+        for(auto& entry : m_entries) {
+            size_t meta_buffer_size = m_meta_buffer.size();
+            m_serializer.serialize(archive, entry.metadata);
+            size_t meta_size = m_meta_buffer.size() - meta_buffer_size;
+            if(first_entry) {
+                // use the first entry metadata size as an estimate for the total size
+                size_t estimated_total_size = header_size + meta_size * m_entries.size() * 1.1;
+                m_meta_buffer.reserve(estimated_total_size);
+                first_entry = false;
+            }
+            m_meta_sizes.push_back(meta_size);
+        }
+        std::memcpy(m_meta_buffer.data(), m_meta_sizes.data(), header_size);
+        return 0;
+    }
+
+    /* Compresses the metadata that follows the sizes header at meta_offset
+     * in m_meta_buffer as a single block, which replaces it if it is smaller.
+     * Returns the codec the partition should decompress the block with, or
+     * CompressionCodec::None if the metadata was left uncompressed.
+     */
+    CompressionCodec compressMetadata(size_t meta_offset) {
+        if(!m_compression.enabled()) return CompressionCodec::None;
+        const size_t content_offset = meta_offset + count()*sizeof(size_t);
+        const size_t content_size   = m_meta_buffer.size() - content_offset;
+        m_compression_scratch.clear();
+        CompressAppend(m_compression, m_meta_buffer.data() + content_offset,
+                       content_size, m_compression_scratch);
+        if(m_compression_scratch.size() >= content_size)
+            return CompressionCodec::None;
+        // the block is smaller than what it replaces, so m_meta_buffer
+        // is not reallocated and keeps its RDMA registration
+        m_meta_buffer.resize(content_offset);
+        m_meta_buffer.insert(m_meta_buffer.end(),
+                             m_compression_scratch.begin(),
+                             m_compression_scratch.end());
+        return m_compression.codec;
+    }
+
+    /* Writes the sizes of metadata serialized by push() right before the
+     * metadata. Returns the offset of the header in m_meta_buffer.
+     */
+    size_t writeMetadataHeader() {
+        return writeSizesHeader(m_meta_buffer, m_meta_header_reserved, m_meta_sizes);
+    }
+
+    /* Writes sizes right before the content that follows the first
+     * reserved bytes of buffer. Returns the offset of the header.
+     */
+    static size_t writeSizesHeader(std::vector<char>& buffer,
+                                   size_t& reserved,
+                                   const std::vector<size_t>& sizes) {
+        const size_t header_size = sizes.size()*sizeof(size_t);
+        if(header_size > reserved) {
+            // more entries than expected, make room for the header
+            // and reserve that much for the next uses of this batch
+            buffer.insert(buffer.begin(), header_size - reserved, 0);
+            reserved = header_size;
+        }
+        const size_t offset = reserved - header_size;
+        std::memcpy(buffer.data() + offset, sizes.data(), header_size);
+        return offset;
+    }
+
+    /* Copies the data of small events into the arena, so the batch
+     * does not expose one segment per event. */
+    void addEntry(diaspora::Metadata metadata,
+                  diaspora::DataView data,
+                  Promise<std::optional<diaspora::EventID>> promise) {
+        size_t arena_offset = NOT_IN_ARENA;
+        const size_t size = data.size();
+        if(size != 0 && size <= m_small_event_threshold) {
+            if(m_data_arena.empty())
+                m_data_arena.resize(m_data_header_reserved);
+            arena_offset = m_data_arena.size();
+            m_data_arena.resize(arena_offset + size);
+            size_t offset = arena_offset;
+            for(const auto& seg : data.segments()) {
+                std::memcpy(m_data_arena.data() + offset, seg.ptr, seg.size);
+                offset += seg.size;
             }
         }
-        if(m_meta_buffer.size() == 0) {
-           m_meta_bulk = thallium::bulk{};
-           return;
+        m_entries.push_back({std::move(metadata), std::move(data), std::move(promise), arena_offset});
+    }
+
+    void exposeMetadata() {
+        /* the registration covers the whole capacity of m_meta_buffer,
+         * so it only needs to change if the buffer was reallocated */
+        if(m_meta_bulk_ptr == m_meta_buffer.data()
+        && m_meta_bulk_capacity >= m_meta_buffer.size()) {
+            return;
         }
         std::vector<std::pair<void *, size_t>> segments;
-        segments.reserve(2);
-        segments.emplace_back(
-            const_cast<size_t*>(m_meta_sizes.data()),
-            m_meta_sizes.size()*sizeof(m_meta_sizes[0]));
         segments.emplace_back(
             const_cast<char*>(m_meta_buffer.data()),
-            m_meta_buffer.size()*sizeof(m_meta_buffer[0]));
+            m_meta_buffer.capacity()*sizeof(m_meta_buffer[0]));
         m_meta_bulk = m_engine.expose(segments, thallium::bulk_mode::read_only);
+        m_meta_bulk_ptr = m_meta_buffer.data();
+        m_meta_bulk_capacity = m_meta_buffer.capacity();
+    }
+
+    void exposeArena() {
+        if(m_arena_bulk_ptr == m_data_arena.data()
+        && m_arena_bulk_capacity >= m_data_arena.size()) {
+            return;
+        }
+        std::vector<std::pair<void *, size_t>> segments;
+        segments.emplace_back(
+            const_cast<char*>(m_data_arena.data()),
+            m_data_arena.capacity());
+        m_arena_bulk = m_engine.expose(segments, thallium::bulk_mode::read_only);
+        m_arena_bulk_ptr = m_data_arena.data();
+        m_arena_bulk_capacity = m_data_arena.capacity();
     }
 
     thallium::bulk exposeData(const std::vector<std::pair<void *, size_t>>& segments) {
@@ -44,7 +44,9 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
     tl::auto_remote_procedure m_consumer_request_events;
     tl::auto_remote_procedure m_consumer_ack_event;
     tl::auto_remote_procedure m_consumer_remove_consumer;
+    tl::auto_remote_procedure m_consumer_grant_credits;
     tl::auto_remote_procedure m_consumer_request_data;
+    tl::auto_remote_procedure m_consumer_request_data_batch;
     /* RPC for Consumers */
     thallium::remote_procedure m_consumer_recv_batch;
     // PartitionManager
@@ -66,7 +68,9 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
     , m_consumer_request_events(define("mofka_consumer_request_events", &ProviderImpl::requestEvents, pool))
     , m_consumer_ack_event(define("mofka_consumer_ack_event", &ProviderImpl::acknowledge, pool))
     , m_consumer_remove_consumer(define("mofka_consumer_remove_consumer", &ProviderImpl::removeConsumer, pool))
+    , m_consumer_grant_credits(define("mofka_consumer_grant_credits", &ProviderImpl::grantCredits, pool))
     , m_consumer_request_data(define("mofka_consumer_request_data", &ProviderImpl::requestData, pool))
+    , m_consumer_request_data_batch(define("mofka_consumer_request_data_batch", &ProviderImpl::requestDataBatch, pool))
     , m_consumer_recv_batch(m_engine.define("mofka_consumer_recv_batch"))
     {
         /* Validate the configuration */
@@ -138,6 +142,7 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
                       const std::string& producer_name,
                       size_t count,
                       bool ack_early_requested,
+                      uint8_t metadata_codec,
                       const BulkRef& metadata,
                       const BulkRef& data) {
         spdlog::trace("[mofka:{}] Received receiveBatch request (topic: {}, count:{}, ack_early:{})",
@@ -146,15 +151,19 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         if(!m_partition_manager) {
             result.error() = "No partition manager attached to this provider";
             result.success() = false;
-            req.respond(result);
+            req.respond(result, PartitionLoad{});
             return;
         }
         try {
-            m_partition_manager->receiveBatch(req, producer_name, count, metadata, data);
+            auto codec = static_cast<CompressionCodec>(metadata_codec);
+            if(ack_early_requested && m_partition_manager->supportsAckEarly())
+                m_partition_manager->receiveBatchAckEarly(req, producer_name, count, codec, metadata, data);
+            else
+                m_partition_manager->receiveBatch(req, producer_name, count, codec, metadata, data);
         } catch(const std::exception& ex) {
             result.error() = ex.what();
             result.success() = false;
-            req.respond(result);
+            req.respond(result, m_partition_manager->load());
         }
         spdlog::trace("[mofka:{}] Done executing receiveBatch", id());
     }
@@ -164,10 +173,11 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
                        size_t partition_index,
                        const std::string& consumer_name,
                        size_t count,
-                       size_t batch_size) {
+                       size_t batch_size,
+                       size_t max_batches) {
         spdlog::trace("[mofka:{}] Received requestEvents request"
-                      " (topic: {}, partition: {}, count: {}, batchsize: {})",
-                      id(), m_topic, partition_index, count, batch_size);
+                      " (topic: {}, partition: {}, count: {}, batchsize: {}, max_batches: {})",
+                      id(), m_topic, partition_index, count, batch_size, max_batches);
         std::shared_ptr<ConsumerHandleImpl> consumer_handle_impl;
         auto consumer_key = ConsumerKey{consumer_ctx, req.get_endpoint(), partition_index};
 
@@ -180,7 +190,8 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
                         consumer_ctx, partition_index,
                         consumer_name, count, m_partition_manager,
                         req.get_endpoint(),
-                        m_consumer_recv_batch);
+                        m_consumer_recv_batch,
+                        max_batches);
                 {
                     auto g = std::unique_lock<tl::mutex>{m_consumers_mtx};
                     m_consumers.emplace(consumer_key, consumer_handle_impl);
@@ -243,6 +254,27 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         spdlog::trace("[mofka:{}] Done executing removeConsumer", id());
     }
 
+    void grantCredits(const tl::request& req,
+                      intptr_t consumer_ctx,
+                      size_t partition_index,
+                      size_t num_batches) {
+        spdlog::trace("[mofka:{}] Received grantCredits request (topic: {}, partition: {}, batches: {})",
+                      id(), m_topic, partition_index, num_batches);
+        Result<void> result;
+        tl::auto_respond<decltype(result)> ensureResponse(req, result);
+        auto consumer_key = ConsumerKey{consumer_ctx, req.get_endpoint(), partition_index};
+        std::shared_ptr<ConsumerHandleImpl> consumer_handle_impl;
+        {
+            auto g = std::unique_lock<tl::mutex>{m_consumers_mtx};
+            auto it = m_consumers.find(consumer_key);
+            if(it != m_consumers.end())
+                consumer_handle_impl = it->second;
+        }
+        // the consumer may have been removed in the meantime
+        if(consumer_handle_impl) consumer_handle_impl->grantCredits(num_batches);
+        spdlog::trace("[mofka:{}] Done executing grantCredits", id());
+    }
+
     void requestData(const tl::request& req,
                      const Cerealized<diaspora::DataDescriptor>& descriptor,
                      const BulkRef& remote_bulk) {
@@ -258,6 +290,26 @@ class ProviderImpl : public tl::provider<ProviderImpl> {
         }
         spdlog::trace("[mofka:{}] Done executing requestData", id());
     }
+
+    void requestDataBatch(const tl::request& req,
+                          const std::vector<Cerealized<diaspora::DataDescriptor>>& descriptors,
+                          const BulkRef& remote_bulk) {
+        spdlog::trace("[mofka:{}] Received requestDataBatch request (topic: {}, count: {})",
+                      id(), m_topic, descriptors.size());
+        Result<std::vector<Result<void>>> result;
+        tl::auto_respond<decltype(result)> ensureResponse(req, result);
+        try {
+            ENSURE_VALID_PARTITION_MANAGER(result);
+            std::vector<diaspora::DataDescriptor> content;
+            content.reserve(descriptors.size());
+            for(auto& d : descriptors) content.push_back(d.content);
+            result = m_partition_manager->getData(content, remote_bulk);
+        } catch(const diaspora::Exception& ex) {
+            result.error() = ex.what();
+            result.success() = false;
+        }
+        spdlog::trace("[mofka:{}] Done executing requestDataBatch", id());
+    }
 };
 
 }
@@ -0,0 +1,174 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef MOFKA_STICKY_PARTITION_SELECTOR_H
+#define MOFKA_STICKY_PARTITION_SELECTOR_H
+
+#include <diaspora/Metadata.hpp>
+#include <diaspora/PartitionSelector.hpp>
+#include <diaspora/Exception.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace mofka {
+
+/**
+ * @brief PartitionSelector that sends consecutive events to the same
+ * partition until a number of events or a number of bytes have been
+ * sent to it, then moves on to the next partition. Compared with a
+ * round-robin selection, this lets the producer's per-partition batches
+ * fill up (and be sent) much faster. Its configuration is of the form:
+ *
+ * {
+ *     "type": "sticky",
+ *     "max_events": 128,
+ *     "max_bytes": 0,
+ *     "size_field": ""
+ * }
+ *
+ * max_events should match the producer's batch size. The selector only
+ * sees the metadata of the events, so max_bytes requires size_field, the
+ * name of a numeric metadata field holding the size of the event.
+ * A value of 0 disables the corresponding limit. max_events and max_bytes
+ * are capped to 2^20-1 and 2^28-1 respectively.
+ *
+ * The current partition and the events and bytes accumulated in it are
+ * packed in a single 64-bit word updated with compare-and-swap, so
+ * selectPartitionFor is lock-free.
+ */
+class StickyPartitionSelector : public diaspora::PartitionSelectorInterface {
+
+    static constexpr unsigned INDEX_BITS  = 16;
+    static constexpr unsigned EVENTS_BITS = 20;
+    static constexpr unsigned BYTES_BITS  = 28;
+    static constexpr uint64_t MAX_EVENTS  = (1ULL << EVENTS_BITS) - 1;
+    static constexpr uint64_t MAX_BYTES   = (1ULL << BYTES_BITS) - 1;
+
+    public:
+
+    StickyPartitionSelector(size_t max_events, size_t max_bytes, std::string size_field)
+    : m_max_events{std::min<uint64_t>(max_events, MAX_EVENTS)}
+    , m_max_bytes{std::min<uint64_t>(max_bytes, MAX_BYTES)}
+    , m_size_field{std::move(size_field)} {
+        if(m_max_events == 0) m_max_events = MAX_EVENTS;
+        if(m_max_bytes == 0 || m_size_field.empty()) m_max_bytes = MAX_BYTES;
+    }
+
+    void setPartitions(const std::vector<diaspora::PartitionInfo>& targets) override {
+        if(targets.size() > (1ULL << INDEX_BITS))
+            throw diaspora::Exception{"Too many partitions for sticky PartitionSelector"};
+        m_targets = targets;
+    }
+
+    size_t selectPartitionFor(const diaspora::Metadata& metadata,
+                              std::optional<size_t> requested) override {
+        if(m_targets.size() == 0)
+            throw diaspora::Exception("PartitionSelector has no target to select from");
+        if(requested.has_value())
+            return requested.value() % m_targets.size();
+        const uint64_t size = std::min(eventSize(metadata), MAX_BYTES);
+        uint64_t state = m_state.load(std::memory_order_relaxed);
+        uint64_t index, desired;
+        do {
+            index           = Index(state);
+            uint64_t events = Events(state);
+            uint64_t bytes  = Bytes(state);
+            if(events != 0 && (events + 1 > m_max_events || bytes + size > m_max_bytes)) {
+                // quota reached, rotate to the next partition
+                index  = (index + 1) % m_targets.size();
+                events = 0;
+                bytes  = 0;
+            }
+            desired = Pack(index, events + 1, bytes + size);
+        } while(!m_state.compare_exchange_weak(
+                    state, desired, std::memory_order_relaxed));
+        return index % m_targets.size();
+    }
+
+    diaspora::Metadata metadata() const override {
+        auto json = nlohmann::json::object();
+        json["type"]       = "sticky";
+        json["max_events"] = m_max_events == MAX_EVENTS ? 0 : m_max_events;
+        json["max_bytes"]  = m_max_bytes == MAX_BYTES ? 0 : m_max_bytes;
+        json["size_field"] = m_size_field;
+        return diaspora::Metadata{std::move(json)};
+    }
+
+    static std::shared_ptr<diaspora::PartitionSelectorInterface> create(
+            const diaspora::Metadata& metadata) {
+        const auto& json = metadata.json();
+        size_t max_events = 128;
+        size_t max_bytes  = 0;
+        std::string size_field;
+        if(json.is_object()) {
+            if(json.contains("max_events")) {
+                if(!json["max_events"].is_number_unsigned())
+                    throw diaspora::Exception{
+                        "\"max_events\" in sticky PartitionSelector should be an unsigned integer"};
+                max_events = json["max_events"].get<size_t>();
+            }
+            if(json.contains("max_bytes")) {
+                if(!json["max_bytes"].is_number_unsigned())
+                    throw diaspora::Exception{
+                        "\"max_bytes\" in sticky PartitionSelector should be an unsigned integer"};
+                max_bytes = json["max_bytes"].get<size_t>();
+            }
+            if(json.contains("size_field")) {
+                if(!json["size_field"].is_string())
+                    throw diaspora::Exception{
+                        "\"size_field\" in sticky PartitionSelector should be a string"};
+                size_field = json["size_field"].get<std::string>();
+            }
+        }
+        if(max_bytes != 0 && size_field.empty())
+            throw diaspora::Exception{
+                "\"max_bytes\" in sticky PartitionSelector requires \"size_field\""};
+        return std::make_shared<StickyPartitionSelector>(
+            max_events, max_bytes, std::move(size_field));
+    }
+
+    private:
+
+    uint64_t eventSize(const diaspora::Metadata& metadata) const {
+        if(m_size_field.empty()) return 0;
+        const auto& json = metadata.json();
+        if(!json.is_object()) return 0;
+        auto it = json.find(m_size_field);
+        if(it == json.end() || !it->is_number_unsigned()) return 0;
+        return it->get<uint64_t>();
+    }
+
+    static uint64_t Index(uint64_t state) {
+        return state >> (EVENTS_BITS + BYTES_BITS);
+    }
+
+    static uint64_t Events(uint64_t state) {
+        return (state >> BYTES_BITS) & MAX_EVENTS;
+    }
+
+    static uint64_t Bytes(uint64_t state) {
+        return state & MAX_BYTES;
+    }
+
+    static uint64_t Pack(uint64_t index, uint64_t events, uint64_t bytes) {
+        return (index << (EVENTS_BITS + BYTES_BITS)) | (events << BYTES_BITS) | bytes;
+    }
+
+    uint64_t                             m_max_events;
+    uint64_t                             m_max_bytes;
+    std::string                          m_size_field;
+    std::vector<diaspora::PartitionInfo> m_targets;
+    std::atomic<uint64_t>                m_state = 0;
+};
+
+}
+
+#endif
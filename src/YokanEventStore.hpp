@@ -194,7 +194,8 @@ class YokanEventStore {
                     local_metadata_bulk,
                     count*(sizeof(size_t) + sizeof(yk_id_t)),
                     metadata_buffer.size(),
-                    self_addr
+                    self_addr,
+                    true
                 };
                 descriptors_sizes_bulk_ref = BulkRef{
                     local_descriptors_bulk,
@@ -206,7 +207,8 @@ class YokanEventStore {
                     local_descriptors_bulk,
                     count*sizeof(size_t),
                     descriptors_sizes_and_data.size() - count*sizeof(size_t),
-                    self_addr
+                    self_addr,
+                    true
                 };
 
             }
@@ -241,6 +243,9 @@ class YokanEventStore {
                 break;
             }
 
+            // wait until the consumer has room for one more batch
+            if(!consumerHandle.acquireCredit()) break;
+
             // list metadata documents
             m_metadata_coll.listBulk(
                     firstID+1, 0, b1->local_metadata_bulk.get_bulk(),
@@ -0,0 +1,117 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <filesystem>
+
+/**
+ * @brief Produces events into a default partition configured with the
+ * given JSON, then consumes them from a new consumer once they are all
+ * stored (so that sealed chunks are read back from disk).
+ */
+static void produceThenConsume(diaspora::Driver& driver,
+                               const std::string& topic_name,
+                               const std::string& partition_config,
+                               unsigned num_events) {
+    REQUIRE_NOTHROW(driver.createTopic(topic_name));
+    mofka::MofkaDriver::Dependencies partition_dependencies = {
+        {"io_controller", {"my_abt_io"}}
+    };
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                topic_name, 0, "default",
+                diaspora::Metadata{partition_config}, partition_dependencies));
+
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic(topic_name));
+    REQUIRE(static_cast<bool>(topic));
+
+    std::vector<std::string> data(num_events);
+    {
+        auto producer = topic.producer("myproducer", driver.defaultThreadPool());
+        REQUIRE(static_cast<bool>(producer));
+        for(unsigned i = 0; i < num_events; ++i) {
+            diaspora::Metadata metadata{fmt::format("{{\"event_num\":{}}}", i)};
+            data[i] = fmt::format("Chunk read data for event {}", i);
+            producer.push(metadata, diaspora::DataView{data[i].data(), data[i].size()});
+        }
+        producer.flush().wait(-1);
+    }
+
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return diaspora::DataView{new char[size], size};
+        };
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    auto consumer = topic.consumer("myconsumer", data_selector, data_allocator);
+    REQUIRE(static_cast<bool>(consumer));
+    for(unsigned i = 0; i < num_events; ++i) {
+        auto opt_event = consumer.pull().wait(-1);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json()["event_num"].get<unsigned>() == i);
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[i]);
+        delete[] static_cast<const char*>(segment.ptr);
+    }
+}
+
+TEST_CASE("Reading chunks back from disk", "[chunk-read]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    SECTION("Sealed chunks served from memory mappings") {
+        std::filesystem::remove_all("/tmp/mofka-chunk-read-mmap-test");
+        // the write cache is disabled so that every read goes to the chunks
+        produceThenConsume(driver, "mmaptopic",
+            R"({"path":"/tmp/mofka-chunk-read-mmap-test",
+                "max_events_per_chunk":16,
+                "write_cache":{"enabled":false}})", 100);
+    }
+
+    SECTION("Mappings larger than the mmap budget fall back to reads") {
+        std::filesystem::remove_all("/tmp/mofka-chunk-read-budget-test");
+        produceThenConsume(driver, "budgettopic",
+            R"({"path":"/tmp/mofka-chunk-read-budget-test",
+                "max_events_per_chunk":16,
+                "mmap_cache_max_bytes":64,
+                "write_cache":{"enabled":false}})", 100);
+    }
+
+    SECTION("Adjacent records coalesced into bounded preads") {
+        std::filesystem::remove_all("/tmp/mofka-chunk-read-pread-test");
+        // without mappings and with a small max_read_size, each batch is
+        // read with several preads that each merge a few records
+        produceThenConsume(driver, "preadtopic",
+            R"({"path":"/tmp/mofka-chunk-read-pread-test",
+                "max_events_per_chunk":16,
+                "mmap_cache_max_bytes":0,
+                "max_read_size":64,
+                "write_cache":{"enabled":false}})", 100);
+    }
+}
@@ -0,0 +1,155 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/Compression.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include <diaspora/Exception.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <cstring>
+#include <random>
+
+TEST_CASE("Metadata compression", "[compression]") {
+
+    auto codec = GENERATE(
+        mofka::CompressionCodec::None,
+        mofka::CompressionCodec::LZ4,
+        mofka::CompressionCodec::Zstd);
+    if(!mofka::CompressionConfig::IsAvailable(codec)) {
+        SKIP("Codec not available in this build");
+    }
+    mofka::CompressionConfig compression;
+    compression.codec = codec;
+
+    SECTION("Round trips, including empty blocks") {
+        std::mt19937 rng{42};
+        std::vector<std::string> inputs = {
+            "",
+            "x",
+            R"({"name":"event","value":42})",
+            std::string(100000, 'a')
+        };
+        std::string random_input(10000, '\0');
+        for(auto& c : random_input) c = static_cast<char>(rng());
+        inputs.push_back(random_input);
+
+        for(auto& input : inputs) {
+            // blocks are appended after whatever the output already holds
+            std::vector<char> block = {'p', 'r', 'e'};
+            mofka::CompressAppend(compression, input.data(), input.size(), block);
+            std::vector<char> output;
+            mofka::Decompress(codec, block.data() + 3, block.size() - 3, output);
+            REQUIRE(std::string{output.data(), output.size()} == input);
+        }
+    }
+
+    SECTION("Blocks with a tampered size header are rejected") {
+        std::string input(1000, 'b');
+        std::vector<char> block;
+        mofka::CompressAppend(compression, input.data(), input.size(), block);
+        size_t huge = size_t{1} << 40;
+        std::memcpy(block.data(), &huge, sizeof(huge));
+        std::vector<char> output;
+        REQUIRE_THROWS_AS(
+            mofka::Decompress(codec, block.data(), block.size(), output),
+            diaspora::Exception);
+        REQUIRE(output.size() < huge);
+    }
+
+    SECTION("Truncated blocks are rejected") {
+        std::string input = R"({"name":"event","value":42})";
+        std::vector<char> block;
+        mofka::CompressAppend(compression, input.data(), input.size(), block);
+        std::vector<char> output;
+        REQUIRE_THROWS_AS(
+            mofka::Decompress(codec, block.data(), sizeof(size_t) - 1, output),
+            diaspora::Exception);
+        REQUIRE_THROWS_AS(
+            mofka::Decompress(codec, block.data(), block.size() - 1, output),
+            diaspora::Exception);
+    }
+}
+
+TEST_CASE("Compressed metadata round trip", "[compression]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto codec_name = GENERATE(as<std::string>{}, "lz4", "zstd");
+    auto compression = mofka::CompressionConfig::FromMetadata(
+        diaspora::Metadata{fmt::format(R"({{"codec":"{}"}})", codec_name)});
+    if(!mofka::CompressionConfig::IsAvailable(compression.codec)) {
+        SKIP("Codec not available in this build");
+    }
+    auto partition_type = GENERATE(as<std::string>{}, "memory", "default");
+    auto serialize_on_push = GENERATE(false, true);
+    CAPTURE(codec_name, partition_type, serialize_on_push);
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic", diaspora::Metadata{
+        fmt::format(R"({{"compression":{{"codec":"{}"}}}})", codec_name)}));
+    if(partition_type == "default") {
+        mofka::MofkaDriver::Dependencies partition_dependencies = {
+            {"io_controller", {"my_abt_io"}}
+        };
+        REQUIRE_NOTHROW(mofka_driver.addCustomPartition(
+            "mytopic", 0, "default",
+            diaspora::Metadata{R"({"path":"/tmp/mofka-compression-test"})"},
+            partition_dependencies));
+    } else {
+        REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    }
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    // the metadata of a batch repeats itself, so its block is smaller
+    // than the serialized metadata and is the one that is sent
+    constexpr size_t num_events = 100;
+    auto make_metadata = [](size_t i) {
+        return fmt::format(R"({{"event_num":{},"label":"{}"}})", i, std::string(i % 50, 'x'));
+    };
+    {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", diaspora::BatchSize{16}, diaspora::MaxNumBatches{2},
+                                diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{fmt::format(
+                                    R"({{"serialize_on_push":{}}})", serialize_on_push)}));
+        REQUIRE(producer);
+        for(size_t i = 0; i < num_events; ++i) {
+            producer->push(diaspora::Metadata{make_metadata(i)}, diaspora::DataView{}, std::nullopt);
+        }
+        producer->flush().wait(-1);
+    }
+
+    diaspora::TopicHandle topic_handle;
+    REQUIRE_NOTHROW(topic_handle = driver.openTopic("mytopic"));
+    auto consumer = topic_handle.consumer("myconsumer");
+    REQUIRE(static_cast<bool>(consumer));
+    for(size_t i = 0; i < num_events; ++i) {
+        auto opt_event = consumer.pull().wait(5000);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json() == nlohmann::json::parse(make_metadata(i)));
+    }
+}
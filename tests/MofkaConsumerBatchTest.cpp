@@ -0,0 +1,88 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include "ConsumerBatchImpl.hpp"
+#include <cstring>
+
+namespace tl = thallium;
+
+TEST_CASE("Consumer batch pulled from bulk references", "[consumer-batch]") {
+
+    tl::engine engine{"na+sm", THALLIUM_SERVER_MODE};
+    auto self_addr = static_cast<std::string>(engine.self());
+    auto pool = std::make_shared<tl::bulk_buffer_pool<>>(
+        engine, 1, 0, 64*1024, 4.0f, tl::bulk_mode::write_only);
+    auto ack_rpc = engine.define("consumer_batch_test_ack");
+    auto lookup = [&engine](const std::string& address) { return engine.lookup(address); };
+
+    const std::vector<std::string> metadata = {R"({"a":1})", R"({"b":22})"};
+    const size_t count = metadata.size();
+    const size_t sizes_bytes = count*sizeof(size_t);
+    std::vector<size_t> meta_sizes;
+    std::string meta_contents;
+    for(auto& m : metadata) {
+        meta_sizes.push_back(m.size());
+        meta_contents += m;
+    }
+    const std::vector<size_t> desc_sizes(count, 0);
+
+    auto check = [&](const std::shared_ptr<mofka::ConsumerBatchImpl>& batch) {
+        batch->prepare(0, nullptr, diaspora::Serializer{}, "myconsumer", ack_rpc);
+        REQUIRE(batch->count() == count);
+        for(size_t i = 0; i < count; ++i) {
+            auto event = mofka::ConsumerBatchImpl::MakeEvent(batch, i, diaspora::DataView{});
+            REQUIRE(std::string{event->rawMetadata()} == metadata[i]);
+        }
+    };
+
+    SECTION("Adjacent regions of different handles are pulled separately") {
+        // the sizes are followed by unrelated bytes in their handle, while the
+        // contents start at the same offset in another handle of the same size
+        std::vector<char> first(2*sizes_bytes, 'x');
+        std::memcpy(first.data(), meta_sizes.data(), sizes_bytes);
+        std::vector<char> second(2*sizes_bytes, 'y');
+        REQUIRE(meta_contents.size() <= sizes_bytes);
+        std::memcpy(second.data() + sizes_bytes, meta_contents.data(), meta_contents.size());
+        std::vector<char> descs(2*sizes_bytes, 0);
+        std::memcpy(descs.data(), desc_sizes.data(), sizes_bytes);
+
+        auto first_bulk  = engine.expose({{first.data(), first.size()}}, tl::bulk_mode::read_only);
+        auto second_bulk = engine.expose({{second.data(), second.size()}}, tl::bulk_mode::read_only);
+        auto descs_bulk  = engine.expose({{descs.data(), descs.size()}}, tl::bulk_mode::read_only);
+
+        auto batch = std::make_shared<mofka::ConsumerBatchImpl>(
+            pool, count, meta_contents.size(), 0);
+        batch->pullFrom(lookup,
+            mofka::BulkRef{first_bulk, 0, sizes_bytes, self_addr},
+            mofka::BulkRef{second_bulk, sizes_bytes, meta_contents.size(), self_addr},
+            mofka::BulkRef{descs_bulk, 0, sizes_bytes, self_addr},
+            mofka::BulkRef{descs_bulk, sizes_bytes, 0, self_addr, true});
+        check(batch);
+    }
+
+    SECTION("Regions that share a handle are pulled together") {
+        std::vector<char> meta(sizes_bytes + meta_contents.size());
+        std::memcpy(meta.data(), meta_sizes.data(), sizes_bytes);
+        std::memcpy(meta.data() + sizes_bytes, meta_contents.data(), meta_contents.size());
+        std::vector<char> descs(sizes_bytes);
+        std::memcpy(descs.data(), desc_sizes.data(), sizes_bytes);
+
+        auto meta_bulk  = engine.expose({{meta.data(), meta.size()}}, tl::bulk_mode::read_only);
+        auto descs_bulk = engine.expose({{descs.data(), descs.size()}}, tl::bulk_mode::read_only);
+
+        auto batch = std::make_shared<mofka::ConsumerBatchImpl>(
+            pool, count, meta_contents.size(), 0);
+        batch->pullFrom(lookup,
+            mofka::BulkRef{meta_bulk, 0, sizes_bytes, self_addr},
+            mofka::BulkRef{meta_bulk, sizes_bytes, meta_contents.size(), self_addr, true},
+            mofka::BulkRef{descs_bulk, 0, sizes_bytes, self_addr},
+            mofka::BulkRef{descs_bulk, sizes_bytes, 0, self_addr, true});
+        check(batch);
+    }
+
+    engine.finalize();
+}
@@ -0,0 +1,144 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaConsumer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <chrono>
+#include <set>
+#include <thread>
+
+TEST_CASE("Consumer data requests", "[consumer-data]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    // 0 requests the data of a whole batch at once
+    auto max_events = GENERATE(as<size_t>{}, 0, 1, 3, 64);
+    // with a window of 1, each request completes before the next is sent
+    auto prefetch_window = GENERATE(as<size_t>{}, 1, 2, 8);
+    CAPTURE(max_events, prefetch_window);
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    constexpr size_t num_events = 100;
+    std::vector<std::string> data(num_events);
+    {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", diaspora::BatchSize{16}, diaspora::MaxNumBatches{2},
+                                diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{"{}"}));
+        REQUIRE(producer);
+        for(size_t i = 0; i < num_events; ++i) {
+            data[i] = fmt::format("data for event {}", i);
+            producer->push(diaspora::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+                           diaspora::DataView{data[i].data(), data[i].size()},
+                           std::nullopt);
+        }
+        producer->flush().wait(-1);
+    }
+
+    // odd events only get the first 4 bytes of their data, and
+    // the allocation fails for the events listed in fail_data
+    std::set<size_t> fail_data;
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+            if(metadata.json()["event_num"].get<size_t>() % 2)
+                return descriptor.makeSubView(0, 4);
+            return descriptor;
+        };
+    diaspora::DataAllocator data_allocator =
+        [&fail_data](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+            if(fail_data.count(metadata.json()["event_num"].get<size_t>()))
+                throw diaspora::Exception{"injected allocation failure"};
+            auto size = descriptor.size();
+            return diaspora::DataView{new char[size], size};
+        };
+    auto make_consumer = [&]() {
+        auto consumer = std::dynamic_pointer_cast<mofka::MofkaConsumer>(
+            topic->makeConsumer("myconsumer", diaspora::BatchSize{16}, diaspora::MaxNumBatches{4},
+                                mofka_driver.defaultThreadPool(), data_allocator, data_selector, {},
+                                diaspora::Metadata{fmt::format(
+                                    R"({{"data_request_max_events":{},"data_prefetch_window":{}}})",
+                                    max_events, prefetch_window)}));
+        REQUIRE(consumer);
+        return consumer;
+    };
+    auto check_event = [&](const diaspora::Event& event, size_t i) {
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json()["event_num"].get<size_t>() == i);
+        auto expected = i % 2 ? data[i].substr(0, 4) : data[i];
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == expected);
+        delete[] static_cast<const char*>(segment.ptr);
+    };
+
+    SECTION("Every event gets the data it selected") {
+        auto consumer = make_consumer();
+        for(size_t i = 0; i < num_events; ++i) {
+            auto opt_event = consumer->pull().wait(5000);
+            REQUIRE(opt_event.has_value());
+            check_event(opt_event.value(), i);
+        }
+    }
+
+    SECTION("Events keep their order when data requests overlap") {
+        // allocations are slow for every third request window, so that the
+        // requests in flight complete while the next ones are being prepared
+        auto window = max_events == 0 ? 16 : max_events;
+        data_allocator =
+            [window](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+                if((metadata.json()["event_num"].get<size_t>() / window) % 3 == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                auto size = descriptor.size();
+                return diaspora::DataView{new char[size], size};
+            };
+        auto consumer = make_consumer();
+        for(size_t i = 0; i < num_events; ++i) {
+            auto opt_event = consumer->pull().wait(5000);
+            REQUIRE(opt_event.has_value());
+            check_event(opt_event.value(), i);
+        }
+    }
+
+    SECTION("A failed allocation only affects its own event") {
+        fail_data = {5, 17, 18};
+        auto consumer = make_consumer();
+        for(size_t i = 0; i < num_events; ++i) {
+            auto future = consumer->pull();
+            if(fail_data.count(i)) {
+                REQUIRE_THROWS_AS(future.wait(5000), diaspora::Exception);
+                continue;
+            }
+            auto opt_event = future.wait(5000);
+            REQUIRE(opt_event.has_value());
+            check_event(opt_event.value(), i);
+        }
+    }
+}
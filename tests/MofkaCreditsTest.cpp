@@ -0,0 +1,149 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaConsumer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "ConsumerHandleImpl.hpp"
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <atomic>
+
+TEST_CASE("Consumer credits", "[credits]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    SECTION("Credits are taken, exhausted and granted back") {
+        auto handle = mofka::ConsumerHandleImpl{
+            0, 0, "myconsumer", 0, nullptr,
+            engine.self(), engine.define("credits_test_recv_batch"), 2};
+        REQUIRE(handle.acquireCredit());
+        REQUIRE(handle.acquireCredit());
+        REQUIRE(handle.m_credits == 0);
+
+        // a feeder without credits waits until the consumer grants some
+        std::atomic<bool> acquired{false};
+        auto feeder = engine.get_handler_pool().make_thread([&]() {
+            acquired = handle.acquireCredit();
+        });
+        for(int i = 0; i < 10; ++i) thallium::thread::yield();
+        REQUIRE(!acquired);
+        handle.grantCredits(1);
+        feeder->join();
+        REQUIRE(acquired);
+        REQUIRE(handle.m_credits == 0);
+
+        // grants never exceed the window
+        handle.grantCredits(5);
+        REQUIRE(handle.m_credits == 2);
+    }
+
+    SECTION("Without a window, credits are unlimited") {
+        auto handle = mofka::ConsumerHandleImpl{
+            0, 0, "myconsumer", 0, nullptr,
+            engine.self(), engine.define("credits_test_recv_batch"), 0};
+        for(int i = 0; i < 100; ++i) REQUIRE(handle.acquireCredit());
+    }
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    // 64 events in batches of 4, so a window of 1 or 2 batches runs out
+    // of credits many times before everything has been consumed
+    constexpr size_t num_events = 64;
+    std::vector<std::string> data(num_events);
+    auto produce = [&]() {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", diaspora::BatchSize{4}, diaspora::MaxNumBatches{2},
+                                diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{"{}"}));
+        REQUIRE(producer);
+        for(size_t i = 0; i < num_events; ++i) {
+            data[i] = fmt::format("data for event {}", i);
+            producer->push(diaspora::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+                           diaspora::DataView{data[i].data(), data[i].size()},
+                           std::nullopt);
+        }
+        producer->flush().wait(-1);
+    };
+
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return diaspora::DataView{new char[size], size};
+        };
+    auto make_consumer = [&](const std::string& name, size_t max_batches) {
+        auto consumer = std::dynamic_pointer_cast<mofka::MofkaConsumer>(
+            topic->makeConsumer(name, diaspora::BatchSize{4}, diaspora::MaxNumBatches{max_batches},
+                                mofka_driver.defaultThreadPool(), data_allocator, data_selector,
+                                {}, diaspora::Metadata{"{}"}));
+        REQUIRE(consumer);
+        return consumer;
+    };
+    auto pull_and_check = [&](mofka::MofkaConsumer& consumer, size_t i) {
+        auto opt_event = consumer.pull().wait(5000);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json()["event_num"].get<size_t>() == i);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[i]);
+        delete[] static_cast<const char*>(segment.ptr);
+    };
+
+    SECTION("Returned credits let the partition send every batch") {
+        produce();
+        for(size_t window : {size_t{1}, size_t{2}}) {
+            auto consumer = make_consumer(fmt::format("myconsumer{}", window), window);
+            for(size_t i = 0; i < num_events; ++i)
+                pull_and_check(*consumer, i);
+        }
+    }
+
+    SECTION("Credits are not held while waiting for events") {
+        // the consumer subscribes before there are events to send
+        auto consumer = make_consumer("myconsumer", 1);
+        produce();
+        for(size_t i = 0; i < num_events; ++i)
+            pull_and_check(*consumer, i);
+    }
+
+    SECTION("A feeder waiting for credits stops with its consumer") {
+        produce();
+        {
+            // the feeder runs out of credits after the first batch
+            auto consumer = make_consumer("myconsumer1", 1);
+            pull_and_check(*consumer, 0);
+        }
+        auto consumer = make_consumer("myconsumer2", 1);
+        for(size_t i = 0; i < num_events; ++i)
+            pull_and_check(*consumer, i);
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+
+/**
+ * @brief Produces events with two data segments of varying sizes into a
+ * default partition configured with the given JSON, then consumes them
+ * selecting, depending on the event, nothing, the whole data, or pieces
+ * spanning both segments, and checks the bytes received.
+ */
+static void produceThenReadData(diaspora::Driver& driver,
+                                const std::string& topic_name,
+                                const std::string& partition_config,
+                                unsigned num_events) {
+    REQUIRE_NOTHROW(driver.createTopic(topic_name));
+    mofka::MofkaDriver::Dependencies partition_dependencies = {
+        {"io_controller", {"my_abt_io"}}
+    };
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                topic_name, 0, "default",
+                diaspora::Metadata{partition_config}, partition_dependencies));
+
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic(topic_name));
+    REQUIRE(static_cast<bool>(topic));
+
+    std::vector<std::string> data(num_events);
+    {
+        auto producer = topic.producer("myproducer", driver.defaultThreadPool());
+        REQUIRE(static_cast<bool>(producer));
+        for(unsigned i = 0; i < num_events; ++i) {
+            diaspora::Metadata metadata{fmt::format("{{\"event_num\":{}}}", i)};
+            auto seg_size = (i % 7) * 10 + 4;
+            data[i].resize(2*seg_size);
+            for(size_t j = 0; j < data[i].size(); ++j)
+                data[i][j] = static_cast<char>('a' + (i + j) % 26);
+            producer.push(metadata, diaspora::DataView{{
+                {data[i].data(), seg_size}, {data[i].data() + seg_size, seg_size}}});
+        }
+        producer.flush().wait(-1);
+    }
+
+    // expected bytes for each event given the selection made below
+    auto expected = [&data](unsigned i) -> std::string {
+        switch(i % 3) {
+            case 0: return "";
+            case 1: return data[i];
+            default: {
+                auto half = data[i].size()/2;
+                return data[i].substr(1, 2) + data[i].substr(half - 1, 3);
+            }
+        }
+    };
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+            auto i = metadata.json()["event_num"].get<unsigned>();
+            switch(i % 3) {
+                case 0: return diaspora::DataDescriptor();
+                case 1: return descriptor;
+                default: {
+                    auto half = descriptor.size()/2;
+                    return descriptor.makeUnstructuredView({{1, 2}, {half - 1, 3}});
+                }
+            }
+        };
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            if(size == 0) return diaspora::DataView{};
+            return diaspora::DataView{new char[size], size};
+        };
+    auto consumer = topic.consumer("myconsumer", data_selector, data_allocator);
+    REQUIRE(static_cast<bool>(consumer));
+    for(unsigned i = 0; i < num_events; ++i) {
+        auto opt_event = consumer.pull().wait(-1);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json()["event_num"].get<unsigned>() == i);
+        auto expected_data = expected(i);
+        REQUIRE(event.data().size() == expected_data.size());
+        if(expected_data.empty()) continue;
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == expected_data);
+        delete[] static_cast<const char*>(segment.ptr);
+    }
+}
+
+TEST_CASE("Reading event data back from disk", "[data-read]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    SECTION("Selected pieces packed in pooled buffers") {
+        // buffers of the pool are much smaller than a data request,
+        // so the pool has to grow to serve them
+        produceThenReadData(driver, "mytopic",
+            R"({"path":"/tmp/mofka-data-read-pool-test",
+                "write_cache":{"enabled":false},
+                "consumers":{"data_buffer_pool":{"num_buffers":1,"first_size":64}}})", 200);
+    }
+
+    SECTION("Data files of many chunks read through a small FD cache") {
+        // each data request spans several chunks while the cache
+        // only keeps one file open at a time
+        produceThenReadData(driver, "mytopic",
+            R"({"path":"/tmp/mofka-data-read-fd-cache-test",
+                "max_events_per_chunk":4,
+                "fd_cache_capacity":1,
+                "mmap_cache_max_bytes":0,
+                "write_cache":{"enabled":false}})", 200);
+    }
+}
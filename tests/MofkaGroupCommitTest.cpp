@@ -0,0 +1,130 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <algorithm>
+
+TEST_CASE("Group commit with concurrent producers", "[group-commit]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    // without linger, groups only hold the batches already queued
+    auto linger_us = GENERATE(as<size_t>{}, 0, 20000);
+    CAPTURE(linger_us);
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+
+    mofka::MofkaDriver::Dependencies partition_dependencies = {
+        {"io_controller", {"my_abt_io"}}
+    };
+    // small chunks so that some groups are split at chunk boundaries
+    diaspora::Metadata partition_config{fmt::format(
+        R"({{"path":"/tmp/mofka-group-commit-test-{}",
+             "max_events_per_chunk":16,
+             "group_commit":{{"enabled":true,"max_batches":8,"max_linger_us":{}}}}})",
+        linger_us, linger_us)};
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                "mytopic", 0, "default",
+                partition_config, partition_dependencies));
+
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+    REQUIRE(static_cast<bool>(topic));
+
+    // events are pushed to the producers in turn and all the producers are
+    // flushed at once, so that the partition receives their batches together
+    constexpr size_t num_producers = 8;
+    constexpr size_t events_per_producer = 40;
+    std::vector<std::vector<std::string>> data(num_producers);
+    std::vector<std::vector<diaspora::EventID>> ids(num_producers);
+    {
+        std::vector<diaspora::Producer> producers;
+        for(size_t p = 0; p < num_producers; ++p) {
+            producers.push_back(topic.producer(
+                fmt::format("myproducer{}", p), driver.defaultThreadPool()));
+            REQUIRE(static_cast<bool>(producers.back()));
+        }
+        std::vector<std::vector<diaspora::Future<std::optional<diaspora::EventID>>>> futures(num_producers);
+        for(size_t i = 0; i < events_per_producer; ++i) {
+            for(size_t p = 0; p < num_producers; ++p) {
+                data[p].push_back(fmt::format("data {} of producer {}", i, p));
+                diaspora::Metadata metadata{fmt::format(
+                    "{{\"producer\":{},\"i\":{}}}", p, i)};
+                futures[p].push_back(producers[p].push(
+                    metadata, diaspora::DataView{data[p][i].data(), data[p][i].size()}));
+            }
+        }
+        std::vector<diaspora::Future<std::optional<diaspora::Flushed>>> flushes;
+        for(auto& producer : producers)
+            flushes.push_back(producer.flush());
+        for(auto& flush : flushes)
+            flush.wait(-1);
+        for(size_t p = 0; p < num_producers; ++p) {
+            for(auto& future : futures[p]) {
+                auto id = future.wait(5000);
+                REQUIRE(id.has_value());
+                ids[p].push_back(id.value());
+            }
+            // each producer's events are stored in push order
+            REQUIRE(std::is_sorted(ids[p].begin(), ids[p].end()));
+        }
+    }
+
+    // every event got its own ID and together they cover
+    // [0, number of events) without gap
+    std::vector<diaspora::EventID> all_ids;
+    for(auto& producer_ids : ids)
+        all_ids.insert(all_ids.end(), producer_ids.begin(), producer_ids.end());
+    std::sort(all_ids.begin(), all_ids.end());
+    for(size_t k = 0; k < all_ids.size(); ++k)
+        REQUIRE(all_ids[k] == k);
+
+    // consumers see each event at the ID its producer was given
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return diaspora::DataView{new char[size], size};
+        };
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    auto consumer = topic.consumer("myconsumer", data_selector, data_allocator);
+    REQUIRE(static_cast<bool>(consumer));
+    for(size_t k = 0; k < all_ids.size(); ++k) {
+        auto opt_event = consumer.pull().wait(5000);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == k);
+        auto& doc = event.metadata().json();
+        auto p = doc["producer"].get<size_t>();
+        auto i = doc["i"].get<size_t>();
+        REQUIRE(p < num_producers);
+        REQUIRE(i < events_per_producer);
+        REQUIRE(ids[p][i] == k);
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[p][i]);
+        delete[] static_cast<const char*>(segment.ptr);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <mofka/MofkaEvent.hpp>
+#include <diaspora/Exception.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace tl = thallium;
+
+/**
+ * @brief Copies bytes into a buffer that events can alias, the way they
+ * alias the buffer of the batch they were received in.
+ */
+static std::shared_ptr<const char> makeRawBuffer(const std::vector<char>& bytes) {
+    auto buffer = std::shared_ptr<char[]>{new char[std::max<size_t>(bytes.size(), 1)]};
+    std::memcpy(buffer.get(), bytes.data(), bytes.size());
+    return std::shared_ptr<const char>{buffer, buffer.get()};
+}
+
+TEST_CASE("Lazy event metadata", "[lazy-metadata]") {
+
+    tl::engine engine{"na+sm", THALLIUM_SERVER_MODE};
+    auto ack_rpc = engine.define("lazy_metadata_test_ack");
+
+    diaspora::Serializer serializer;
+    diaspora::Metadata metadata{R"({"name":"event","values":[1,2,3]})"};
+    std::vector<char> serialized;
+    {
+        diaspora::BufferWrapperOutputArchive archive(serialized);
+        serializer.serialize(archive, metadata);
+    }
+    auto make_event = [&](const std::vector<char>& raw,
+                          std::optional<diaspora::Metadata> provided = std::nullopt) {
+        return mofka::MofkaEvent{
+            42, nullptr, makeRawBuffer(raw), raw.size(), serializer,
+            diaspora::DataView{}, "myconsumer", ack_rpc, std::move(provided)};
+    };
+
+    SECTION("Metadata is deserialized from the raw bytes on first access") {
+        auto raw = makeRawBuffer(serialized);
+        std::weak_ptr<const char> weak_raw = raw;
+        {
+            auto event = mofka::MofkaEvent{
+                42, nullptr, std::move(raw), serialized.size(), serializer,
+                diaspora::DataView{}, "myconsumer", ack_rpc};
+            auto bytes = event.rawMetadata();
+            REQUIRE(std::string{bytes} == std::string{serialized.data(), serialized.size()});
+            REQUIRE(event.metadata().json() == metadata.json());
+            // later calls return the same object
+            REQUIRE(&event.metadata() == &event.metadata());
+            // the event keeps the buffer it aliases alive
+            REQUIRE(!weak_raw.expired());
+        }
+        REQUIRE(weak_raw.expired());
+    }
+
+    // same bytes with every '{' replaced, so that they no longer hold valid JSON
+    auto garbage = serialized;
+    std::replace(garbage.begin(), garbage.end(), '{', '#');
+
+    SECTION("Invalid bytes only fail when the metadata is accessed") {
+        auto event = make_event(garbage);
+        REQUIRE(event.id() == 42);
+        REQUIRE(event.rawMetadata().size() == garbage.size());
+        REQUIRE_THROWS(event.metadata());
+    }
+
+    SECTION("Provided metadata is used without deserializing the raw bytes") {
+        auto event = make_event(garbage, metadata);
+        REQUIRE(event.metadata().json() == metadata.json());
+    }
+
+    engine.finalize();
+}
@@ -0,0 +1,176 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include "KeyHashPartitionSelector.hpp"
+#include "StickyPartitionSelector.hpp"
+#include "LoadAwarePartitionSelector.hpp"
+#include <fmt/format.h>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+static std::vector<diaspora::PartitionInfo> makeTargets(size_t count) {
+    std::vector<diaspora::PartitionInfo> targets(count);
+    for(size_t i = 0; i < count; ++i)
+        targets[i].json()["uuid"] = fmt::format("selector-test-partition-{}", i);
+    return targets;
+}
+
+TEST_CASE("key_hash partition selector", "[partition-selector]") {
+
+    mofka::KeyHashPartitionSelector selector{"key"};
+    selector.setPartitions(makeTargets(7));
+
+    SECTION("Keys are pinned to the partition given by FNV-1a") {
+        // FNV-1a("a") = 0xaf63dc4c8601ec8c, FNV-1a("foobar") = 0x85944171f73967e8
+        for(int i = 0; i < 3; ++i) {
+            REQUIRE(selector.selectPartitionFor(
+                diaspora::Metadata{R"({"key":"a"})"}, std::nullopt) == 5);
+            REQUIRE(selector.selectPartitionFor(
+                diaspora::Metadata{R"({"key":"foobar"})"}, std::nullopt) == 6);
+        }
+        // non-string values are hashed through their JSON representation,
+        // FNV-1a("42") = 0x07ee7e07b4b19223
+        REQUIRE(selector.selectPartitionFor(
+            diaspora::Metadata{R"({"key":42})"}, std::nullopt) == 5);
+    }
+
+    SECTION("JSON pointers reach nested keys") {
+        mofka::KeyHashPartitionSelector nested{"/a/key"};
+        nested.setPartitions(makeTargets(7));
+        REQUIRE(nested.selectPartitionFor(
+            diaspora::Metadata{R"({"a":{"key":"foobar"}})"}, std::nullopt) == 6);
+    }
+
+    SECTION("Events without the key are distributed round-robin") {
+        std::vector<size_t> selected;
+        for(int i = 0; i < 14; ++i) {
+            selected.push_back(selector.selectPartitionFor(
+                diaspora::Metadata{R"({"other":"a"})"}, std::nullopt));
+        }
+        for(size_t i = 1; i < selected.size(); ++i)
+            REQUIRE(selected[i] == (selected[i-1] + 1) % 7);
+    }
+
+    SECTION("A requested partition takes precedence over the key") {
+        REQUIRE(selector.selectPartitionFor(
+            diaspora::Metadata{R"({"key":"a"})"}, 2) == 2);
+        REQUIRE(selector.selectPartitionFor(
+            diaspora::Metadata{R"({"key":"a"})"}, 9) == 2);
+    }
+
+    SECTION("Configuration") {
+        REQUIRE_THROWS_AS(mofka::KeyHashPartitionSelector::create(diaspora::Metadata{"{}"}),
+                          diaspora::Exception);
+        auto created = mofka::KeyHashPartitionSelector::create(
+            diaspora::Metadata{R"({"type":"key_hash","key":"key"})"});
+        REQUIRE(created->metadata().json()["key"] == "key");
+    }
+}
+
+TEST_CASE("sticky partition selector", "[partition-selector]") {
+
+    diaspora::Metadata no_size{R"({"x":1})"};
+
+    SECTION("Rotation after max_events") {
+        mofka::StickyPartitionSelector selector{3, 0, ""};
+        selector.setPartitions(makeTargets(3));
+        std::vector<size_t> expected = {0, 0, 0, 1, 1, 1, 2, 2, 2, 0, 0, 0};
+        for(auto e : expected)
+            REQUIRE(selector.selectPartitionFor(no_size, std::nullopt) == e);
+    }
+
+    SECTION("Rotation after max_bytes") {
+        mofka::StickyPartitionSelector selector{100, 100, "size"};
+        selector.setPartitions(makeTargets(3));
+        auto sized = [](size_t size) {
+            return diaspora::Metadata{fmt::format("{{\"size\":{}}}", size)};
+        };
+        REQUIRE(selector.selectPartitionFor(sized(60), std::nullopt) == 0);
+        REQUIRE(selector.selectPartitionFor(sized(40), std::nullopt) == 0);
+        // 101 bytes would exceed the quota
+        REQUIRE(selector.selectPartitionFor(sized(1), std::nullopt) == 1);
+        // an event larger than the quota still goes to the partition it starts
+        REQUIRE(selector.selectPartitionFor(sized(500), std::nullopt) == 1);
+        REQUIRE(selector.selectPartitionFor(sized(1), std::nullopt) == 2);
+        // events without the size field count for 0 bytes
+        REQUIRE(selector.selectPartitionFor(no_size, std::nullopt) == 2);
+    }
+
+    SECTION("Concurrent selections respect the quota") {
+        mofka::StickyPartitionSelector selector{8, 0, ""};
+        selector.setPartitions(makeTargets(4));
+        constexpr size_t num_threads = 4;
+        constexpr size_t num_events  = 8*4*100;
+        std::vector<size_t> counts(4, 0);
+        std::mutex mutex;
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&]() {
+                std::vector<size_t> local(4, 0);
+                for(size_t i = 0; i < num_events/num_threads; ++i)
+                    local[selector.selectPartitionFor(no_size, std::nullopt)] += 1;
+                auto g = std::unique_lock<std::mutex>{mutex};
+                for(size_t p = 0; p < 4; ++p) counts[p] += local[p];
+            });
+        }
+        for(auto& t : threads) t.join();
+        // every rotation hands out exactly max_events selections
+        for(auto c : counts) REQUIRE(c == num_events/4);
+    }
+
+    SECTION("Configuration") {
+        REQUIRE_THROWS_AS(mofka::StickyPartitionSelector::create(
+            diaspora::Metadata{R"({"max_bytes":100})"}), diaspora::Exception);
+        auto created = mofka::StickyPartitionSelector::create(
+            diaspora::Metadata{R"({"max_events":16})"});
+        REQUIRE(created->metadata().json()["max_events"] == 16);
+        REQUIRE(created->metadata().json()["max_bytes"] == 0);
+    }
+}
+
+TEST_CASE("load_aware partition selector", "[partition-selector]") {
+
+    diaspora::Metadata metadata{R"({"x":1})"};
+    auto targets = makeTargets(2);
+    // the selector shares its statistics with the producers of the process
+    auto busy = mofka::PartitionLoadStats::ForPartition(
+        targets[1].json()["uuid"].get<std::string>());
+
+    SECTION("Events avoid a busy partition") {
+        mofka::LoadAwarePartitionSelector selector{{}};
+        selector.setPartitions(targets);
+        busy->update(mofka::PartitionLoad{10, 1024*1024}, std::chrono::microseconds{500});
+        for(int i = 0; i < 100; ++i)
+            REQUIRE(selector.selectPartitionFor(metadata, std::nullopt) == 0);
+        // a requested partition is honored regardless of its load
+        REQUIRE(selector.selectPartitionFor(metadata, 1) == 1);
+    }
+
+    SECTION("Stale statistics let the partition be probed again") {
+        mofka::LoadAwarePartitionSelector::Weights weights;
+        weights.stale_after_us = 1000;
+        mofka::LoadAwarePartitionSelector selector{weights};
+        selector.setPartitions(targets);
+        busy->update(mofka::PartitionLoad{10, 1024*1024}, std::chrono::microseconds{500});
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        std::set<size_t> selected;
+        for(int i = 0; i < 100; ++i)
+            selected.insert(selector.selectPartitionFor(metadata, std::nullopt));
+        REQUIRE(selected.size() == 2);
+    }
+
+    SECTION("Configuration") {
+        REQUIRE_THROWS_AS(mofka::LoadAwarePartitionSelector::create(
+            diaspora::Metadata{R"({"queue_weight":"high"})"}), diaspora::Exception);
+        auto created = mofka::LoadAwarePartitionSelector::create(
+            diaspora::Metadata{R"({"queue_weight":5.0})"});
+        REQUIRE(created->metadata().json()["queue_weight"] == 5.0);
+        REQUIRE(created->metadata().json()["latency_weight"] == 1.0);
+    }
+}
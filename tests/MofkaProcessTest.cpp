@@ -0,0 +1,173 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaConsumer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+TEST_CASE("Consumer process", "[process]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    constexpr size_t num_partitions = 2;
+    constexpr size_t num_events     = 200;
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    for(size_t p = 0; p < num_partitions; ++p)
+        REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+    auto thread_pool = mofka_driver.makeThreadPool(diaspora::ThreadCount{4});
+
+    // events alternate between the partitions, each with its number as data
+    std::vector<std::string> data(num_events);
+    {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", diaspora::BatchSize{16}, diaspora::MaxNumBatches{2},
+                                diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{"{}"}));
+        REQUIRE(producer);
+        for(size_t i = 0; i < num_events; ++i) {
+            data[i] = std::to_string(i);
+            producer->push(diaspora::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+                           diaspora::DataView{data[i].data(), data[i].size()},
+                           i % num_partitions);
+        }
+        producer->flush().wait(-1);
+    }
+
+    // the allocator fails for the events listed in fail_data
+    std::set<size_t> fail_data;
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    diaspora::DataAllocator data_allocator =
+        [&fail_data](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+            if(fail_data.count(metadata.json()["event_num"].get<size_t>()))
+                throw diaspora::Exception{"injected allocation failure"};
+            auto size = descriptor.size();
+            return diaspora::DataView{new char[size], size};
+        };
+    auto make_consumer = [&](const std::string& consumer_options) {
+        auto consumer = std::dynamic_pointer_cast<mofka::MofkaConsumer>(
+            topic->makeConsumer("myconsumer", diaspora::BatchSize{16}, diaspora::MaxNumBatches{4},
+                                mofka_driver.defaultThreadPool(), data_allocator, data_selector,
+                                {}, diaspora::Metadata{consumer_options}));
+        REQUIRE(consumer);
+        return consumer;
+    };
+    // processors run in the thread pool, where Catch2 assertions cannot
+    // be used, so mismatches are counted and checked afterwards
+    std::atomic<size_t> bad_data{0};
+    auto check_data = [&](const diaspora::Event& event) {
+        auto event_num = event.metadata().json()["event_num"].get<size_t>();
+        if(event.data().segments().size() != 1) {
+            bad_data += 1;
+            return event_num;
+        }
+        auto& segment = event.data().segments()[0];
+        if(std::string{(const char*)segment.ptr, segment.size} != data[event_num])
+            bad_data += 1;
+        delete[] static_cast<const char*>(segment.ptr);
+        return event_num;
+    };
+
+    SECTION("At most process_max_concurrency tasks run at once") {
+        auto consumer = make_consumer(
+            R"({"process_max_concurrency":2,"data_request_max_events":4})");
+        std::atomic<size_t> running{0};
+        std::atomic<size_t> max_running{0};
+        std::atomic<size_t> processed{0};
+        consumer->process(
+            [&](const diaspora::Event& event) {
+                auto now_running = running.fetch_add(1) + 1;
+                auto prev_max = max_running.load();
+                while(now_running > prev_max
+                   && !max_running.compare_exchange_weak(prev_max, now_running)) {}
+                std::this_thread::sleep_for(std::chrono::microseconds{200});
+                check_data(event);
+                processed += 1;
+                running.fetch_sub(1);
+            }, 5000, diaspora::NumEvents{num_events}, thread_pool);
+        REQUIRE(processed == num_events);
+        REQUIRE(bad_data == 0);
+        REQUIRE(max_running >= 1);
+        REQUIRE(max_running <= 2);
+    }
+
+    SECTION("process_ordered processes each partition in order") {
+        auto consumer = make_consumer(
+            R"({"process_max_concurrency":4,"process_ordered":true,"data_request_max_events":4})");
+        std::mutex mutex;
+        std::map<std::string, std::vector<diaspora::EventID>> ids;
+        consumer->process(
+            [&](const diaspora::Event& event) {
+                check_data(event);
+                std::this_thread::sleep_for(std::chrono::microseconds{(event.id() % 7) * 50});
+                auto uuid = event.partition().json()["uuid"].get<std::string>();
+                std::unique_lock<std::mutex> guard{mutex};
+                ids[uuid].push_back(event.id());
+            }, 5000, diaspora::NumEvents{num_events}, thread_pool);
+        REQUIRE(bad_data == 0);
+        REQUIRE(ids.size() == num_partitions);
+        for(auto& [uuid, partition_ids] : ids) {
+            REQUIRE(partition_ids.size() == num_events/num_partitions);
+            for(size_t i = 0; i < partition_ids.size(); ++i)
+                REQUIRE(partition_ids[i] == i);
+        }
+    }
+
+    SECTION("Events whose data cannot be fetched are skipped") {
+        for(size_t i = 3; i < num_events; i += 10) fail_data.insert(i);
+        auto consumer = make_consumer(R"({"data_request_max_events":4})");
+        // process() returns once no event was processed for 500ms,
+        // after all the events have been either processed or skipped
+        std::mutex mutex;
+        std::set<size_t> seen;
+        REQUIRE_THROWS_WITH(
+            consumer->process(
+                [&](const diaspora::Event& event) {
+                    auto event_num = check_data(event);
+                    std::unique_lock<std::mutex> guard{mutex};
+                    seen.insert(event_num);
+                }, 500, diaspora::NumEvents{num_events}, thread_pool),
+            Catch::Matchers::ContainsSubstring(
+                fmt::format("{} event(s) were not processed", fail_data.size()))
+            && Catch::Matchers::ContainsSubstring("injected allocation failure"));
+        // the processing went on past the failures
+        REQUIRE(bad_data == 0);
+        REQUIRE(seen.size() == num_events - fail_data.size());
+        for(auto i : fail_data) REQUIRE(seen.count(i) == 0);
+    }
+}
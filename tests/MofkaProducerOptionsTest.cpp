@@ -0,0 +1,274 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <chrono>
+#include <set>
+#include <thread>
+
+/**
+ * @brief Pushes events with the given data using a producer created with
+ * the given options, then checks that a consumer reads them back intact.
+ */
+static void pushThenCheck(diaspora::TopicHandle& topic,
+                          diaspora::Driver& driver,
+                          const std::string& producer_options,
+                          const std::vector<std::string>& data) {
+    {
+        auto producer = topic.producer(
+            "myproducer", driver.defaultThreadPool(), diaspora::Metadata{producer_options});
+        REQUIRE(static_cast<bool>(producer));
+        std::vector<diaspora::Future<std::optional<diaspora::EventID>>> futures;
+        for(size_t i = 0; i < data.size(); ++i) {
+            diaspora::Metadata metadata{fmt::format("{{\"event_num\":{}}}", i)};
+            futures.push_back(producer.push(
+                metadata, diaspora::DataView{(void*)data[i].data(), data[i].size()}));
+        }
+        producer.flush().wait(-1);
+        for(size_t i = 0; i < futures.size(); ++i) {
+            auto id = futures[i].wait(5000);
+            REQUIRE(id.has_value());
+            REQUIRE(id.value() == i);
+        }
+    }
+
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return diaspora::DataView{size ? new char[size] : nullptr, size};
+        };
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    auto consumer = topic.consumer("myconsumer", data_selector, data_allocator);
+    REQUIRE(static_cast<bool>(consumer));
+    for(size_t i = 0; i < data.size(); ++i) {
+        auto opt_event = consumer.pull().wait(5000);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        REQUIRE(event.id() == i);
+        REQUIRE(event.metadata().json()["event_num"].get<size_t>() == i);
+        REQUIRE(event.data().size() == data[i].size());
+        if(data[i].empty()) continue;
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[i]);
+        delete[] static_cast<const char*>(segment.ptr);
+    }
+}
+
+/**
+ * @brief Pushes events with the given metadata and data to a single
+ * partition using a MofkaProducer with the given batching parameters, then
+ * checks that a consumer reads back every event intact. With Strict
+ * ordering, events must also get IDs in push order.
+ */
+static void pushBatchesThenCheck(mofka::MofkaDriver& mofka_driver,
+                                 std::shared_ptr<mofka::MofkaTopicHandle> topic,
+                                 diaspora::BatchSize batch_size,
+                                 diaspora::MaxNumBatches max_batches,
+                                 diaspora::Ordering ordering,
+                                 const std::string& producer_options,
+                                 const std::vector<std::string>& metadata,
+                                 const std::vector<std::string>& data) {
+    {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", batch_size, max_batches, ordering,
+                                mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{producer_options}));
+        REQUIRE(producer);
+        std::vector<diaspora::Future<std::optional<diaspora::EventID>>> futures;
+        for(size_t i = 0; i < data.size(); ++i) {
+            futures.push_back(producer->push(
+                diaspora::Metadata{metadata[i]},
+                diaspora::DataView{(void*)data[i].data(), data[i].size()},
+                std::nullopt));
+        }
+        producer->flush().wait(-1);
+        std::set<diaspora::EventID> ids;
+        for(size_t i = 0; i < futures.size(); ++i) {
+            auto id = futures[i].wait(5000);
+            REQUIRE(id.has_value());
+            if(ordering == diaspora::Ordering::Strict)
+                REQUIRE(id.value() == i);
+            ids.insert(id.value());
+        }
+        // every event got its own ID, in [0, number of events)
+        REQUIRE(ids.size() == data.size());
+        REQUIRE(*ids.rbegin() == data.size() - 1);
+    }
+
+    diaspora::DataAllocator data_allocator =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            auto size = descriptor.size();
+            return diaspora::DataView{size ? new char[size] : nullptr, size};
+        };
+    diaspora::DataSelector data_selector =
+        [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+            return descriptor;
+        };
+    auto consumer = topic->makeConsumer(
+        "myconsumer", diaspora::BatchSize::Adaptive(), diaspora::MaxNumBatches{2},
+        mofka_driver.defaultThreadPool(), data_allocator, data_selector, {},
+        diaspora::Metadata{"{}"});
+    REQUIRE(consumer);
+    std::set<size_t> seen;
+    for(size_t i = 0; i < data.size(); ++i) {
+        auto opt_event = consumer->pull().wait(5000);
+        REQUIRE(opt_event.has_value());
+        auto& event = opt_event.value();
+        auto event_num = event.metadata().json()["event_num"].get<size_t>();
+        REQUIRE(event_num < data.size());
+        REQUIRE(seen.insert(event_num).second);
+        REQUIRE(event.metadata().json() == nlohmann::json::parse(metadata[event_num]));
+        REQUIRE(event.data().size() == data[event_num].size());
+        if(data[event_num].empty()) continue;
+        REQUIRE(event.data().segments().size() == 1);
+        auto& segment = event.data().segments()[0];
+        REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[event_num]);
+        delete[] static_cast<const char*>(segment.ptr);
+    }
+}
+
+TEST_CASE("Producer options", "[producer-options]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                "mytopic", 0, "memory", diaspora::Metadata{"{}"}, {}));
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+
+    SECTION("small_event_threshold with events that all have empty data") {
+        pushThenCheck(topic, driver, R"({"small_event_threshold":64})",
+                      std::vector<std::string>(10));
+    }
+
+    SECTION("small_event_threshold with small, empty, and large events") {
+        std::vector<std::string> data;
+        for(size_t i = 0; i < 30; ++i) {
+            if(i % 3 == 0)      data.push_back(fmt::format("small {}", i));
+            else if(i % 3 == 1) data.push_back("");
+            else                data.push_back(std::string(256, 'a' + (i % 26)));
+        }
+        pushThenCheck(topic, driver, R"({"small_event_threshold":64})", data);
+    }
+}
+
+TEST_CASE("Producer batches", "[producer-options]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    constexpr size_t num_events = 300;
+    std::vector<std::string> metadata, data;
+    for(size_t i = 0; i < num_events; ++i) {
+        metadata.push_back(fmt::format("{{\"event_num\":{}}}", i));
+        data.push_back(fmt::format("data for event {}", i));
+    }
+
+    SECTION("Several batches in flight with Loose ordering") {
+        pushBatchesThenCheck(mofka_driver, topic, diaspora::BatchSize{4}, diaspora::MaxNumBatches{8},
+                             diaspora::Ordering::Loose, "{}", metadata, data);
+    }
+
+    SECTION("A single batch in flight with Strict ordering") {
+        pushBatchesThenCheck(mofka_driver, topic, diaspora::BatchSize{4}, diaspora::MaxNumBatches{8},
+                             diaspora::Ordering::Strict, "{}", metadata, data);
+    }
+
+    SECTION("Reused batches with metadata growing and shrinking") {
+        // the metadata of a batch ranges from a few bytes to tens of KiB, so
+        // reused batches have to grow their buffer and register it again
+        for(size_t i = 0; i < num_events; ++i) {
+            auto pad = std::string((i * 7919) % (16*1024), 'a' + (i % 26));
+            metadata[i] = fmt::format("{{\"event_num\":{},\"pad\":\"{}\"}}", i, pad);
+        }
+        pushBatchesThenCheck(mofka_driver, topic, diaspora::BatchSize{4}, diaspora::MaxNumBatches{2},
+                             diaspora::Ordering::Strict, "{}", metadata, data);
+    }
+    SECTION("serialize_on_push") {
+        auto ordering = GENERATE(diaspora::Ordering::Strict, diaspora::Ordering::Loose);
+        pushBatchesThenCheck(mofka_driver, topic, diaspora::BatchSize{4}, diaspora::MaxNumBatches{4},
+                             ordering, R"({"serialize_on_push":true})", metadata, data);
+    }
+
+    SECTION("batch_linger_us and batch_max_bytes send batches before they are full") {
+        // with a batch size of 1000 events, the events below are only
+        // sent before flush() because of the linger time or byte threshold
+        auto producer_options = GENERATE(
+            std::string{R"({"batch_linger_us":2000})"},
+            std::string{R"({"batch_max_bytes":256})"});
+        CAPTURE(producer_options);
+        constexpr size_t num_early = 20;
+        std::string early_data(64, 'x');
+        {
+            auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+                topic->makeProducer("myproducer", diaspora::BatchSize{1000}, diaspora::MaxNumBatches{2},
+                                    diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                    diaspora::Metadata{producer_options}));
+            REQUIRE(producer);
+            std::vector<diaspora::Future<std::optional<diaspora::EventID>>> futures;
+            for(size_t i = 0; i < num_early; ++i) {
+                futures.push_back(producer->push(
+                    diaspora::Metadata{metadata[i]},
+                    diaspora::DataView{early_data.data(), early_data.size()},
+                    std::nullopt));
+            }
+            // the first event is acknowledged without any flush(): the future
+            // is only polled, since waiting on it would flush the producer
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{2};
+            while(!futures[0].completed() && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            REQUIRE(futures[0].completed());
+            producer->flush().wait(-1);
+            for(size_t i = 0; i < num_early; ++i) {
+                auto id = futures[i].wait(5000);
+                REQUIRE(id.has_value());
+                REQUIRE(id.value() == i);
+            }
+        }
+    }
+}
@@ -0,0 +1,279 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "MPSCRingBuffer.hpp"
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <set>
+#include <thread>
+
+TEST_CASE("MPSC ring buffer", "[ring-buffer]") {
+
+    SECTION("Capacity, full ring and wrap-around") {
+        mofka::MPSCRingBuffer<std::string> ring{5};
+        REQUIRE(ring.capacity() == 8);
+        REQUIRE(ring.empty());
+        // several rounds so that positions wrap around the cells
+        for(size_t round = 0; round < 5; ++round) {
+            for(size_t i = 0; i < ring.capacity(); ++i) {
+                std::string value = std::to_string(round*100 + i);
+                size_t position = 0;
+                REQUIRE(ring.tryPush(value, &position));
+                REQUIRE(position == round*ring.capacity() + i);
+            }
+            // the ring is full: the push fails and leaves the value alone
+            std::string extra = "extra";
+            REQUIRE(!ring.tryPush(extra));
+            REQUIRE(extra == "extra");
+            REQUIRE(!ring.empty());
+            for(size_t i = 0; i < ring.capacity(); ++i) {
+                std::string value;
+                REQUIRE(ring.tryPop(value));
+                REQUIRE(value == std::to_string(round*100 + i));
+            }
+            std::string value;
+            REQUIRE(!ring.tryPop(value));
+            REQUIRE(ring.empty());
+            REQUIRE(ring.popped() == (round+1)*ring.capacity());
+            REQUIRE(ring.pushed() == ring.popped());
+        }
+    }
+
+    SECTION("Several producers and one consumer") {
+        constexpr size_t num_producers = 4;
+        constexpr size_t num_values    = 100000;
+        // a small ring so that producers keep hitting the full path
+        mofka::MPSCRingBuffer<std::pair<size_t, size_t>> ring{16};
+        std::vector<std::thread> producers;
+        for(size_t p = 0; p < num_producers; ++p) {
+            producers.emplace_back([&ring, p]() {
+                for(size_t i = 0; i < num_values; ++i) {
+                    auto value = std::make_pair(p, i);
+                    while(!ring.tryPush(value)) std::this_thread::yield();
+                }
+            });
+        }
+        // each producer's values come out in the order it pushed them
+        std::vector<size_t> next(num_producers, 0);
+        size_t popped = 0;
+        while(popped < num_producers*num_values) {
+            std::pair<size_t, size_t> value;
+            if(!ring.tryPop(value)) {
+                std::this_thread::yield();
+                continue;
+            }
+            REQUIRE(value.first < num_producers);
+            REQUIRE(value.second == next[value.first]);
+            next[value.first] += 1;
+            popped += 1;
+        }
+        for(auto& t : producers) t.join();
+        REQUIRE(ring.empty());
+        REQUIRE(std::all_of(next.begin(), next.end(),
+                            [](size_t n) { return n == num_values; }));
+    }
+}
+
+TEST_CASE("Producer queue with concurrent pushers", "[producer-queue]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                "mytopic", 0, "memory", diaspora::Metadata{"{}"}, {}));
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+
+    // with an adaptive batch size, waiting on a future does not flush,
+    // so an event whose push failed to wake up the sender is never sent
+    auto producer_options = GENERATE(
+        std::string{R"({})"},
+        std::string{R"({"batch_linger_us":500})"},
+        std::string{R"({"batch_max_bytes":256})"});
+
+    SECTION("The sender is woken up for every event") {
+        auto producer = topic.producer(
+            "myproducer", driver.defaultThreadPool(), diaspora::Metadata{producer_options});
+        REQUIRE(static_cast<bool>(producer));
+
+        constexpr size_t num_pushers = 4;
+        constexpr size_t num_events  = 2000;
+        std::vector<std::vector<diaspora::Future<std::optional<diaspora::EventID>>>> futures(num_pushers);
+        std::vector<std::thread> pushers;
+        for(size_t p = 0; p < num_pushers; ++p) {
+            pushers.emplace_back([&, p]() {
+                for(size_t i = 0; i < num_events; ++i) {
+                    diaspora::Metadata metadata{
+                        fmt::format("{{\"pusher\":{},\"i\":{}}}", p, i)};
+                    futures[p].push_back(producer.push(metadata, diaspora::DataView{0, nullptr}));
+                    // pauses let the sender drain the ring and go to sleep
+                    if(i % 250 == 0)
+                        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+                }
+            });
+        }
+        for(auto& t : pushers) t.join();
+
+        std::set<diaspora::EventID> ids;
+        for(auto& pusher_futures : futures) {
+            for(auto& future : pusher_futures) {
+                auto id = future.wait(5000);
+                REQUIRE(id.has_value());
+                ids.insert(id.value());
+            }
+        }
+        REQUIRE(ids.size() == num_pushers*num_events);
+        REQUIRE(*ids.rbegin() == num_pushers*num_events - 1);
+    }
+}
+
+TEST_CASE("Producer tryPush and stats", "[producer-queue]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    // two partitions with the default (round-robin) selector
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    // the only thread of the pool is blocked, so the senders do not
+    // run and the queues fill up
+    auto thread_pool = mofka_driver.makeThreadPool(diaspora::ThreadCount{1});
+    std::promise<void> unblock;
+    auto unblocked = unblock.get_future().share();
+    thread_pool->pushWork([unblocked]() { unblocked.wait(); });
+
+    auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+        topic->makeProducer("myproducer", diaspora::BatchSize{64}, diaspora::MaxNumBatches{1},
+                            diaspora::Ordering::Strict, thread_pool, diaspora::Metadata{"{}"}));
+    REQUIRE(producer);
+    bool released = false;
+    ENSURE(if(!released) unblock.set_value());
+
+    SECTION("Rejected events are left to the caller and still move the selector") {
+        const std::string data = "12345678";
+        std::vector<diaspora::Future<std::optional<diaspora::EventID>>> futures;
+        // fill the ring of partition 0 (64 events per batch, 1 batch: 256 slots)
+        size_t capacity = 0;
+        while(true) {
+            diaspora::Metadata metadata{fmt::format("{{\"i\":{}}}", capacity)};
+            diaspora::DataView view{(void*)data.data(), data.size()};
+            auto future = producer->tryPush(metadata, view, 0);
+            if(!future) {
+                REQUIRE(metadata.json()["i"] == capacity);
+                REQUIRE(view.size() == data.size());
+                break;
+            }
+            futures.push_back(std::move(*future));
+            capacity += 1;
+            REQUIRE(capacity <= 8192);
+        }
+        REQUIRE(capacity == 256);
+
+        auto stats = producer->stats();
+        REQUIRE(stats.pushed_events == capacity);
+        REQUIRE(stats.queued_events == capacity);
+        REQUIRE(stats.queued_bytes == capacity*data.size());
+        REQUIRE(stats.in_flight_batches == 0);
+
+        // with a timeout, the push still fails once the timeout has passed
+        auto start = std::chrono::steady_clock::now();
+        {
+            diaspora::Metadata metadata{R"({"i":"timeout"})"};
+            diaspora::DataView view{(void*)data.data(), data.size()};
+            REQUIRE(!producer->tryPush(metadata, view, 0, std::chrono::milliseconds{20}));
+        }
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds{20});
+
+        // without a requested partition, the round-robin selector alternates
+        // between the full partition 0 and partition 1 whether or not the
+        // events are rejected, and a timeout bounds the wait on partition 0
+        std::vector<diaspora::Future<std::optional<diaspora::EventID>>> partition1_futures;
+        for(int i = 0; i < 2; ++i) {
+            {
+                diaspora::Metadata metadata{R"({"i":"rejected"})"};
+                diaspora::DataView view{(void*)data.data(), data.size()};
+                start = std::chrono::steady_clock::now();
+                REQUIRE(!producer->tryPush(metadata, view, std::nullopt,
+                                           std::chrono::milliseconds{20*i}));
+                REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds{20*i});
+                REQUIRE(metadata.json()["i"] == "rejected");
+                REQUIRE(view.size() == data.size());
+            }
+            {
+                diaspora::Metadata metadata{R"({"i":"partition1"})"};
+                diaspora::DataView view{(void*)data.data(), data.size()};
+                auto future = producer->tryPush(metadata, view);
+                REQUIRE(future.has_value());
+                partition1_futures.push_back(std::move(*future));
+            }
+        }
+        stats = producer->stats();
+        REQUIRE(stats.pushed_events == capacity + 2);
+        REQUIRE(stats.queued_events == capacity + 2);
+
+        released = true;
+        unblock.set_value();
+        // the selector's next choice is partition 0 again, which
+        // accepts the event once its sender drains the ring
+        {
+            diaspora::Metadata metadata{R"({"i":"selected"})"};
+            diaspora::DataView view{(void*)data.data(), data.size()};
+            auto future = producer->tryPush(metadata, view, std::nullopt, std::chrono::seconds{5});
+            REQUIRE(future.has_value());
+            producer->flush().wait(-1);
+            REQUIRE(future->wait(5000) == capacity);
+        }
+        for(size_t i = 0; i < capacity; ++i)
+            REQUIRE(futures[i].wait(5000) == i);
+        for(size_t i = 0; i < partition1_futures.size(); ++i)
+            REQUIRE(partition1_futures[i].wait(5000) == i);
+
+        stats = producer->stats();
+        REQUIRE(stats.pushed_events == capacity + 3);
+        REQUIRE(stats.queued_events == 0);
+        REQUIRE(stats.queued_bytes == 0);
+        REQUIRE(stats.in_flight_batches == 0);
+    }
+}
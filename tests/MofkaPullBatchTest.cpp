@@ -0,0 +1,96 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/MofkaProducer.hpp>
+#include <mofka/MofkaConsumer.hpp>
+#include <mofka/MofkaTopicHandle.hpp>
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <chrono>
+#include <thread>
+
+TEST_CASE("Consumer pullBatch", "[pull-batch]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+    auto& mofka_driver = driver.as<mofka::MofkaDriver>();
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+    REQUIRE_NOTHROW(mofka_driver.addCustomPartition("mytopic", 0, "memory"));
+    auto topic = std::dynamic_pointer_cast<mofka::MofkaTopicHandle>(
+        mofka_driver.openTopic("mytopic"));
+    REQUIRE(topic);
+
+    constexpr size_t num_events = 256;
+    std::vector<std::string> data(num_events);
+    {
+        auto producer = std::dynamic_pointer_cast<mofka::MofkaProducer>(
+            topic->makeProducer("myproducer", diaspora::BatchSize{8}, diaspora::MaxNumBatches{2},
+                                diaspora::Ordering::Strict, mofka_driver.defaultThreadPool(),
+                                diaspora::Metadata{"{}"}));
+        REQUIRE(producer);
+        for(size_t i = 0; i < num_events; ++i) {
+            data[i] = fmt::format("data for event {}", i);
+            producer->push(diaspora::Metadata{fmt::format("{{\"event_num\":{}}}", i)},
+                           diaspora::DataView{data[i].data(), data[i].size()},
+                           std::nullopt);
+        }
+        producer->flush().wait(-1);
+    }
+
+    SECTION("Batches of a partition are delivered in order") {
+        // the allocator is slower for every other group of 8 events, so that
+        // the ULTs handling consecutive batches complete out of order
+        diaspora::DataSelector data_selector =
+            [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+                return descriptor;
+            };
+        diaspora::DataAllocator data_allocator =
+            [](const diaspora::Metadata& metadata, const diaspora::DataDescriptor& descriptor) {
+                auto event_num = metadata.json()["event_num"].get<size_t>();
+                if((event_num / 8) % 2 == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                auto size = descriptor.size();
+                return diaspora::DataView{new char[size], size};
+            };
+        auto consumer = std::dynamic_pointer_cast<mofka::MofkaConsumer>(
+            topic->makeConsumer("myconsumer", diaspora::BatchSize{8}, diaspora::MaxNumBatches{8},
+                                mofka_driver.makeThreadPool(diaspora::ThreadCount{4}),
+                                data_allocator, data_selector, {},
+                                diaspora::Metadata{R"({"pull_batches":true,"data_request_max_events":4})"}));
+        REQUIRE(consumer);
+
+        diaspora::EventID next = 0;
+        while(next < num_events) {
+            auto batch = consumer->pullBatch(0, 5000);
+            REQUIRE(!batch.empty());
+            for(size_t i = 0; i < batch.size(); ++i) {
+                REQUIRE(batch.id(i) == next);
+                REQUIRE(batch.metadata(i).json()["event_num"].get<size_t>() == next);
+                auto& segment = batch.data(i).segments()[0];
+                REQUIRE(std::string{(const char*)segment.ptr, segment.size} == data[next]);
+                delete[] static_cast<const char*>(segment.ptr);
+                next += 1;
+            }
+        }
+        REQUIRE(consumer->pullBatch(0, 100).empty());
+    }
+}
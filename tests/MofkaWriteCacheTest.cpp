@@ -101,6 +101,87 @@ TEST_CASE("Write-cache producer/consumer test", "[write-cache]") {
         // Cache hit stats are logged at info level during partition destruction
     }
 
+    SECTION("Produce and consume with a write cache that evicts batches") {
+        diaspora::Metadata options;
+        options.json()["group_file"] = "mofka.json";
+        options.json()["margo"] = nlohmann::json::object();
+        options.json()["margo"]["use_progress_thread"] = true;
+        diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+        REQUIRE(static_cast<bool>(driver));
+
+        REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+
+        mofka::MofkaDriver::Dependencies partition_dependencies = {
+            {"io_controller", {"my_abt_io"}}
+        };
+        // Keep only a couple of small batches, so that consumers read some
+        // events from the cache and the others from disk
+        diaspora::Metadata partition_config{
+            R"({"path":"/tmp/mofka-write-cache-evict-test","write_cache":{"enabled":true,"max_batches":2,"max_memory_bytes":2048}})"};
+
+        REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                    "mytopic", 0, "default",
+                    partition_config, partition_dependencies));
+
+        diaspora::TopicHandle topic;
+        REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+        REQUIRE(static_cast<bool>(topic));
+
+        const unsigned NUM_EVENTS = 300;
+
+        // Produce events (adaptive batch size sends each event quickly,
+        // so most batches are evicted by the time they are consumed)
+        {
+            std::vector<std::string> data(NUM_EVENTS);
+            auto producer = topic.producer("myproducer", driver.defaultThreadPool());
+            REQUIRE(static_cast<bool>(producer));
+            for(unsigned i = 0; i < NUM_EVENTS; ++i) {
+                diaspora::Metadata metadata = diaspora::Metadata{
+                    fmt::format("{{\"event_num\":{}}}", i)
+                };
+                data[i] = fmt::format("Write-cache data for event {}", i);
+                auto future = producer.push(
+                    metadata,
+                    diaspora::DataView{data[i].data(), data[i].size()});
+            }
+            producer.flush().wait(-1);
+        }
+
+        // Consume and verify all events, whether cached or not
+        {
+            diaspora::DataAllocator data_allocator =
+                    [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+                auto size = descriptor.size();
+                auto buf = new char[size];
+                return diaspora::DataView{buf, size};
+            };
+            diaspora::DataSelector data_selector =
+                [](const diaspora::Metadata&, const diaspora::DataDescriptor& descriptor) {
+                    return descriptor;
+                };
+            auto consumer = topic.consumer(
+                "myconsumer",
+                data_selector,
+                data_allocator);
+            REQUIRE(static_cast<bool>(consumer));
+            for(unsigned i = 0; i < NUM_EVENTS; ++i) {
+                auto opt_event = consumer.pull().wait(-1);
+                REQUIRE(opt_event.has_value());
+                auto& event = opt_event.value();
+                REQUIRE(event.id() == i);
+                auto& doc = event.metadata().json();
+                REQUIRE(doc["event_num"].get<int64_t>() == i);
+                REQUIRE(event.data().segments().size() == 1);
+                auto data_str = std::string{
+                    (const char*)event.data().segments()[0].ptr,
+                    event.data().segments()[0].size};
+                std::string expected = fmt::format("Write-cache data for event {}", i);
+                REQUIRE(data_str == expected);
+                delete[] static_cast<const char*>(event.data().segments()[0].ptr);
+            }
+        }
+    }
+
     SECTION("Produce with ack_early + write cache, consume and verify") {
         diaspora::Metadata options;
         options.json()["group_file"] = "mofka.json";
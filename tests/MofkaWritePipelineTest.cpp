@@ -0,0 +1,250 @@
+/*
+ * (C) 2025 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_all.hpp>
+#include <bedrock/Server.hpp>
+#include <diaspora/Driver.hpp>
+#include <diaspora/TopicHandle.hpp>
+#include <mofka/BulkRef.hpp>
+#include <mofka/Compression.hpp>
+#include "Result.hpp"
+#include "PartitionLoad.hpp"
+#include "Configs.hpp"
+#include "Ensure.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace tl = thallium;
+
+/**
+ * @brief Batch sent directly with the mofka_producer_send_batch RPC,
+ * laid out the way MofkaProducer lays it out (sizes then contents).
+ */
+struct RawBatch {
+
+    std::vector<std::string> metadata;
+    std::vector<char>        meta_buffer;
+    std::vector<size_t>      data_sizes;
+    tl::bulk                 meta_bulk;
+    tl::bulk                 data_bulk;
+
+    RawBatch(tl::engine& engine, const std::string& name, size_t count) {
+        std::vector<size_t> sizes;
+        for(size_t i = 0; i < count; ++i) {
+            metadata.push_back(fmt::format("{{\"batch\":\"{}\",\"i\":{}}}", name, i));
+            sizes.push_back(metadata.back().size());
+        }
+        meta_buffer.resize(count * sizeof(size_t));
+        std::memcpy(meta_buffer.data(), sizes.data(), meta_buffer.size());
+        for(auto& m : metadata) meta_buffer.insert(meta_buffer.end(), m.begin(), m.end());
+        data_sizes.resize(count, 0);
+        meta_bulk = engine.expose(
+            {{meta_buffer.data(), meta_buffer.size()}}, tl::bulk_mode::read_only);
+        data_bulk = engine.expose(
+            {{data_sizes.data(), data_sizes.size()*sizeof(size_t)}}, tl::bulk_mode::read_only);
+    }
+
+    // A BulkRef extending past the exposed region makes the partition's pull fail
+    tl::async_response send(tl::remote_procedure& rpc, const tl::provider_handle& ph,
+                            const std::string& self_addr, bool faulty = false) {
+        auto meta_size = meta_buffer.size() + (faulty ? 4096 : 0);
+        return rpc.on(ph).async(
+            std::string{"raw-producer"}, data_sizes.size(), false,
+            static_cast<uint8_t>(mofka::CompressionCodec::None),
+            mofka::BulkRef{meta_bulk, 0, meta_size, self_addr},
+            mofka::BulkRef{data_bulk, 0, data_sizes.size()*sizeof(size_t), self_addr});
+    }
+};
+
+TEST_CASE("Write pipeline with a failed pull", "[write-pipeline]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    SECTION("IDs stay contiguous around a batch whose pull fails") {
+        diaspora::Metadata options;
+        options.json()["group_file"] = "mofka.json";
+        options.json()["margo"] = nlohmann::json::object();
+        options.json()["margo"]["use_progress_thread"] = true;
+        diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+        REQUIRE(static_cast<bool>(driver));
+
+        REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+
+        mofka::MofkaDriver::Dependencies partition_dependencies = {
+            {"io_controller", {"my_abt_io"}}
+        };
+        // small chunks so that groups are split into several pipelined runs
+        diaspora::Metadata partition_config{
+            R"({"path":"/tmp/mofka-write-pipeline-test",
+                "max_events_per_chunk":4,
+                "write_pipeline_depth":2,
+                "group_commit":{"enabled":true,"max_batches":8,"max_linger_us":20000}})"};
+
+        REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                    "mytopic", 0, "default",
+                    partition_config, partition_dependencies));
+
+        diaspora::TopicHandle topic;
+        REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+        REQUIRE(static_cast<bool>(topic));
+
+        auto info = topic.partitions()[0].json();
+        auto ph = tl::provider_handle{
+            engine.lookup(info["address"].get<std::string>()),
+            info["provider_id"].get<uint16_t>()};
+        auto send_batch = engine.define("mofka_producer_send_batch");
+        auto self_addr = static_cast<std::string>(engine.self());
+
+        const std::vector<std::pair<std::string, size_t>> layout = {
+            {"a", 3}, {"b", 2}, {"faulty", 5}, {"c", 4}, {"d", 1}
+        };
+        std::vector<std::unique_ptr<RawBatch>> batches;
+        std::vector<tl::async_response> responses;
+        for(auto& [name, count] : layout) {
+            batches.push_back(std::make_unique<RawBatch>(engine, name, count));
+            responses.push_back(batches.back()->send(send_batch, ph, self_addr, name == "faulty"));
+        }
+
+        // (first id, batch index) of the batches that were stored
+        std::vector<std::pair<diaspora::EventID, size_t>> stored;
+        for(size_t k = 0; k < responses.size(); ++k) {
+            auto [result, load] = responses[k].wait()
+                .as<mofka::Result<diaspora::EventID>, mofka::PartitionLoad>();
+            if(layout[k].first == "faulty") {
+                REQUIRE(!result.success());
+                continue;
+            }
+            REQUIRE(result.success());
+            stored.emplace_back(result.value(), k);
+        }
+        std::sort(stored.begin(), stored.end());
+
+        // the stored batches cover [0, 10) without gap
+        diaspora::EventID next_id = 0;
+        for(auto& [first_id, k] : stored) {
+            REQUIRE(first_id == next_id);
+            next_id += layout[k].second;
+        }
+        REQUIRE(next_id == 10);
+
+        // a regular producer continues right after them
+        {
+            auto producer = topic.producer("myproducer", driver.defaultThreadPool());
+            REQUIRE(static_cast<bool>(producer));
+            diaspora::Metadata metadata{R"({"batch":"producer","i":0})"};
+            auto future = producer.push(metadata, diaspora::DataView{0, nullptr});
+            producer.flush().wait(-1);
+            REQUIRE(future.wait(-1) == 10);
+        }
+
+        // consumers see every stored event at the ID its producer was given
+        {
+            auto consumer = topic.consumer("myconsumer");
+            REQUIRE(static_cast<bool>(consumer));
+            for(auto& [first_id, k] : stored) {
+                for(size_t i = 0; i < layout[k].second; ++i) {
+                    auto opt_event = consumer.pull().wait(-1);
+                    REQUIRE(opt_event.has_value());
+                    auto& event = opt_event.value();
+                    REQUIRE(event.id() == first_id + i);
+                    auto& doc = event.metadata().json();
+                    REQUIRE(doc["batch"].get<std::string>() == layout[k].first);
+                    REQUIRE(doc["i"].get<size_t>() == i);
+                }
+            }
+            auto opt_event = consumer.pull().wait(-1);
+            REQUIRE(opt_event.has_value());
+            REQUIRE(opt_event.value().id() == 10);
+            REQUIRE(opt_event.value().metadata().json()["batch"] == "producer");
+        }
+    }
+}
+
+TEST_CASE("Write pipeline with a chunk that fails to open", "[write-pipeline]") {
+
+    spdlog::set_level(spdlog::level::from_str("critical"));
+    auto remove_file = EnsureFileRemoved{"mofka.json"};
+
+    auto server = bedrock::Server("na+sm", config);
+    ENSURE(server.finalize());
+    auto engine = server.getMargoManager().getThalliumEngine();
+
+    diaspora::Metadata options;
+    options.json()["group_file"] = "mofka.json";
+    options.json()["margo"] = nlohmann::json::object();
+    options.json()["margo"]["use_progress_thread"] = true;
+    diaspora::Driver driver = diaspora::Driver::New("mofka", options);
+    REQUIRE(static_cast<bool>(driver));
+
+    REQUIRE_NOTHROW(driver.createTopic("mytopic"));
+
+    // a directory in place of the second chunk's .meta file
+    // makes the rotation to that chunk fail
+    const std::string base_path = "/tmp/mofka-write-pipeline-open-test";
+    auto partition_uuid = mofka::UUID::generate();
+    auto partition_path = base_path + "/mytopic-" + partition_uuid.to_string();
+    auto blocker = partition_path + "/chunk-000001.meta";
+    std::filesystem::remove_all(base_path);
+    std::filesystem::create_directories(blocker);
+
+    mofka::MofkaDriver::Dependencies partition_dependencies = {
+        {"io_controller", {"my_abt_io"}}
+    };
+    diaspora::Metadata partition_config{fmt::format(
+        R"({{"path":"{}","max_events_per_chunk":4}})", base_path)};
+    REQUIRE_NOTHROW(driver.as<mofka::MofkaDriver>().addCustomPartition(
+                "mytopic", 0, "default",
+                partition_config, partition_dependencies, partition_uuid));
+
+    diaspora::TopicHandle topic;
+    REQUIRE_NOTHROW(topic = driver.openTopic("mytopic"));
+    REQUIRE(static_cast<bool>(topic));
+
+    auto info = topic.partitions()[0].json();
+    auto ph = tl::provider_handle{
+        engine.lookup(info["address"].get<std::string>()),
+        info["provider_id"].get<uint16_t>()};
+    auto send_batch = engine.define("mofka_producer_send_batch");
+    auto self_addr = static_cast<std::string>(engine.self());
+
+    auto send = [&](const std::string& name, size_t count) {
+        auto batch = RawBatch{engine, name, count};
+        auto [result, load] = batch.send(send_batch, ph, self_addr).wait()
+            .as<mofka::Result<diaspora::EventID>, mofka::PartitionLoad>();
+        return result;
+    };
+
+    // fills the first chunk, after which the rotation fails
+    auto first = send("a", 4);
+    REQUIRE(first.success());
+    REQUIRE(first.value() == 0);
+
+    // the chunk still can't be opened: this batch is lost
+    REQUIRE(!send("b", 2).success());
+
+    // once it can, the next batch is stored, after the IDs of the lost one
+    std::filesystem::remove(blocker);
+    auto third = send("c", 3);
+    REQUIRE(third.success());
+    REQUIRE(third.value() == 6);
+    REQUIRE(std::filesystem::is_regular_file(blocker));
+    REQUIRE(std::filesystem::file_size(blocker) > 0);
+
+    {
+        auto producer = topic.producer("myproducer", driver.defaultThreadPool());
+        REQUIRE(static_cast<bool>(producer));
+        diaspora::Metadata metadata{R"({"batch":"producer","i":0})"};
+        auto future = producer.push(metadata, diaspora::DataView{0, nullptr});
+        producer.flush().wait(-1);
+        REQUIRE(future.wait(-1) == 9);
+    }
+}